@@ -107,3 +107,45 @@ JSValue js_debugger_build_backtrace(JSContext *ctx, const uint8_t *cur_pc)
     }
     return ret;
 }
+
+/* Writes the names of the functions on the current stack to buf, outermost first and separated
+   by ';' (the "collapsed stack" format read by flame graph tools). Unlike js_debugger_build_backtrace()
+   this creates no JS objects, so it is cheap enough to call from an interrupt handler while profiling.
+   Only the innermost 64 frames are included. Returns the length of the string written to buf. */
+size_t js_debugger_get_collapsed_stack(JSContext *ctx, char *buf, size_t buf_size)
+{
+    JSStackFrame *sf;
+    const char *names[64];
+    int num_frames = 0;
+    size_t len = 0;
+    int i;
+
+    if (buf_size == 0)
+        return 0;
+    buf[0] = '\0';
+    for(sf = ctx->rt->current_stack_frame; sf != NULL && num_frames < 64; sf = sf->prev_frame) {
+        names[num_frames++] = get_func_name(ctx, sf->cur_func);
+    }
+    for (i = num_frames - 1; i >= 0; i--) {
+        const char *name = (names[i] && names[i][0] != '\0') ? names[i] : "<anonymous>";
+        int written = snprintf(buf + len, buf_size - len, "%s%s", len > 0 ? ";" : "", name);
+        if (written > 0) {
+            len += (size_t)written;
+            if (len >= buf_size)
+                len = buf_size - 1;
+        }
+        JS_FreeCString(ctx, names[i]);
+    }
+    return len;
+}
+
+/* Identifies the bytecode format written by JS_WriteObject(), for embedders that
+   keep compiled bytecode between runs. JS_ReadObject() does not verify its input,
+   so only bytecode written by the same build may be read back. */
+const char *js_debugger_get_bytecode_version(void)
+{
+    static char version[64];
+    if (version[0] == '\0')
+        snprintf(version, sizeof(version), "%s/bc%d/%d", CONFIG_VERSION, (int)BC_VERSION, (int)sizeof(void *));
+    return version;
+}
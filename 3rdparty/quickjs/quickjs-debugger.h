@@ -35,6 +35,8 @@ JSValue js_debugger_get_current_funcObject(JSContext *ctx);
 JSValue js_debugger_get_caller_funcObject(JSContext *ctx);
 JSValue js_debugger_get_caller_name(JSContext *ctx);
 JSValue js_debugger_build_backtrace(JSContext *ctx, const uint8_t *cur_pc);
+size_t js_debugger_get_collapsed_stack(JSContext *ctx, char *buf, size_t buf_size);
+const char *js_debugger_get_bytecode_version(void);
 
 #ifdef __cplusplus
 } /* extern "C" { */
@@ -0,0 +1,76 @@
+// Version directive is set by Warzone when loading the shader
+// (This shader supports GLSL 1.50 core and GLSL ES 3.00 only - instanced draws require OpenGL 3.3 / OpenGL ES 3.0.)
+
+//#pragma debug(on)
+
+uniform mat4 ProjectionMatrix;
+uniform int hasTangents; // whether tangents were calculated for model
+uniform vec4 lightPosition;
+
+in vec4 vertex;
+in vec3 vertexNormal;
+in vec2 vertexTexCoord;
+in vec4 vertexTangent;
+
+// per-instance attributes
+in mat4 instanceModelViewMatrix;
+in vec4 instanceColour;
+in vec4 instanceTeamColour;
+in vec4 instancePackedValues; // x = stretch, y = ecmEffect, z = alphaTest
+
+out float vertexDistance;
+out vec3 normal, lightDir, halfVec;
+out vec2 texCoord;
+flat out vec4 colour;
+flat out vec4 teamcolour;
+flat out mat3 NormalMatrix;
+flat out int ecmEffect;
+flat out int alphaTest;
+
+void main()
+{
+	// Pass texture coordinates and per-instance values to fragment shader
+	texCoord = vertexTexCoord;
+	colour = instanceColour;
+	teamcolour = instanceTeamColour;
+	ecmEffect = int(instancePackedValues.y);
+	alphaTest = int(instancePackedValues.z);
+
+	// Lighting we pass to the fragment shader
+	mat3 normalMatrix = transpose(inverse(mat3(instanceModelViewMatrix)));
+	NormalMatrix = normalMatrix;
+	vec4 viewVertex = instanceModelViewMatrix * vec4(vertex.xyz, -vertex.w); // FIXME
+	vec3 eyeVec = normalize(-viewVertex.xyz);
+	vec3 n = normalize(normalMatrix * vertexNormal);
+	lightDir = normalize(lightPosition.xyz);
+
+	if (hasTangents != 0)
+	{
+		// Building the matrix Eye Space -> Tangent Space with handness
+		vec3 t = normalize(normalMatrix * vertexTangent.xyz);
+		vec3 b = cross (n, t) * vertexTangent.w;
+		mat3 TangentSpaceMatrix = mat3(t, n, b);
+
+		// Transform light and eye direction vectors by tangent basis
+		lightDir *= TangentSpaceMatrix;
+		eyeVec *= TangentSpaceMatrix;
+	}
+
+	normal = n;
+	halfVec = lightDir + eyeVec;
+
+	// Implement building stretching to accommodate terrain
+	vec4 position = vertex;
+	if (vertex.y <= 0.0) // use vertex here directly to help shader compiler optimization
+	{
+		position.y -= instancePackedValues.x;
+	}
+
+	// Translate every vertex according to the Model View and Projection Matrix
+	mat4 ModelViewProjectionMatrix = ProjectionMatrix * instanceModelViewMatrix;
+	vec4 gposition = ModelViewProjectionMatrix * position;
+	gl_Position = gposition;
+
+	// Remember vertex distance
+	vertexDistance = gposition.z;
+}
@@ -35,6 +35,16 @@ WzConfig::~WzConfig()
 	if (mWarning == ReadAndWrite)
 	{
 		ASSERT(mObjStack.empty(), "Some json groups have not been closed, stack size %zu.", mObjStack.size());
+		if (mFormat == Cbor)
+		{
+			std::vector<uint8_t> cborData = nlohmann::json::to_cbor(mRoot);
+#if SIZE_MAX >= UDWORD_MAX
+			ASSERT(cborData.size() <= static_cast<size_t>(std::numeric_limits<UDWORD>::max()), "cborData.size (%zu) exceeds UDWORD::max", cborData.size());
+#endif
+			saveFile(mFilename.toUtf8().c_str(), reinterpret_cast<const char *>(cborData.data()), static_cast<UDWORD>(cborData.size()));
+			debug(LOG_SAVE, "Saving %s", mFilename.toUtf8().c_str());
+			return;
+		}
 		std::ostringstream stream;
 		stream << mRoot.dump(4) << std::endl;
 		std::string jsonString = stream.str();
@@ -68,7 +78,7 @@ static nlohmann::json jsonMerge(nlohmann::json original, const nlohmann::json& o
 	return original;
 }
 
-WzConfig::WzConfig(const WzString &name, WzConfig::warning warning)
+WzConfig::WzConfig(const WzString &name, WzConfig::warning warning, WzConfig::format format)
 : mArray(nlohmann::json::array())
 {
 	UDWORD size = 0;
@@ -77,6 +87,7 @@ WzConfig::WzConfig(const WzString &name, WzConfig::warning warning)
 	mFilename = name;
 	mStatus = true;
 	mWarning = warning;
+	mFormat = format;
 	pCurrentObj = &mRoot;
 
 	if (!PHYSFS_exists(name.toUtf8().c_str()))
@@ -104,6 +115,20 @@ WzConfig::WzConfig(const WzString &name, WzConfig::warning warning)
 	}
 	ASSERT_OR_RETURN(, data != nullptr, "Null data?");
 
+	if (format == Cbor)
+	{
+		try {
+			mRoot = nlohmann::json::from_cbor(reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size);
+		}
+		catch (const std::exception &e) {
+			ASSERT(false, "CBOR document from %s is invalid: %s", name.toUtf8().c_str(), e.what());
+		}
+		free(data);
+		pCurrentObj = &mRoot;
+		ASSERT(mRoot.is_object(), "CBOR document from %s is not an object", name.toUtf8().c_str());
+		debug(LOG_SAVE, "Opening %s", name.toUtf8().c_str());
+		return; // binary documents are machine-written, so never have diffs
+	}
 	try {
 		mRoot = nlohmann::json::parse(data, data + size);
 	}
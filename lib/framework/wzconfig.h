@@ -96,6 +96,9 @@ class WzConfig
 {
 public:
 	enum warning { ReadAndWrite, ReadOnly, ReadOnlyAndRequired };
+	/// On-disk encoding of the document. Cbor is a compact binary encoding of the same data, much quicker
+	/// to write and parse than indented JSON text, for large machine-written files such as script states.
+	enum format { Json, Cbor };
 
 private:
 	nlohmann::json mRoot = nlohmann::json::object();
@@ -108,9 +111,10 @@ private:
 	WzString mFilename;
 	bool mStatus;
 	warning mWarning;
+	format mFormat;
 
 public:
-	WzConfig(const WzString &name, WzConfig::warning warning);
+	WzConfig(const WzString &name, WzConfig::warning warning, WzConfig::format format = Json);
 	~WzConfig();
 
 	Vector3f vector3f(const WzString &name);
@@ -57,6 +57,7 @@ static uint32_t gameQueueTime[MAX_GAMEQUEUE_SLOTS];
 static uint32_t gameQueueCheckTime[MAX_GAMEQUEUE_SLOTS];
 static uint32_t gameQueueCheckCrc[MAX_GAMEQUEUE_SLOTS];
 static bool     crcError = false;
+static GameTimeSyncStats syncStats;
 
 static uint32_t updateReadyTime = 0;
 static uint32_t updateWantedTime = 0;
@@ -120,6 +121,7 @@ void gameTimeInit(void)
 
 	// Don't let syncDebug from previous games cause a desynch dump at gameTime 102.
 	crcError = false;
+	syncStats = GameTimeSyncStats();
 	resetSyncDebug();
 }
 
@@ -411,6 +413,9 @@ void sendPlayerGameTime()
 	uint32_t checkTime = gameTime;
 	GameCrcType checkCrc = nextDebugSync();
 
+	syncStats.lastCheckTime = checkTime;
+	syncStats.lastCheckCrc = checkCrc;
+
 	for (player = 0; player < MAX_CONNECTED_PLAYERS; ++player)
 	{
 		if (!myResponsibility(player))
@@ -419,10 +424,7 @@ void sendPlayerGameTime()
 		}
 
 		NETbeginEncode(NETgameQueue(player), GAME_GAME_TIME);
-		NETuint32_t(&latencyTicks);
-		NETuint32_t(&checkTime);
-		NETuint16_t(&checkCrc);
-		NETuint16_t(&wantedLatency);
+		NETfields(latencyTicks, checkTime, checkCrc, wantedLatency);
 		NETend();
 	}
 }
@@ -439,6 +441,11 @@ bool gtimeShouldWaitForPlayer(unsigned player)
 	return shouldWaitForPlayerSlot(player);
 }
 
+GameTimeSyncStats const &gameTimeGetSyncStats()
+{
+	return syncStats;
+}
+
 static inline bool shouldCheckDebugSyncForPlayerSlot(unsigned player)
 {
 	return NetPlay.players[player].allocated	// human player
@@ -455,10 +462,7 @@ void recvPlayerGameTime(NETQUEUE queue)
 	GameCrcType checkCrc = 0;
 
 	NETbeginDecode(queue, GAME_GAME_TIME);
-	NETuint32_t(&latencyTicks);
-	NETuint32_t(&checkTime);
-	NETuint16_t(&checkCrc);
-	NETuint16_t(&wantedLatencies[queue.index]);
+	NETfields(latencyTicks, checkTime, checkCrc, wantedLatencies[queue.index]);
 	NETend();
 
 	gameQueueTime[queue.index] = checkTime + latencyTicks * GAME_TICKS_PER_UPDATE;  // gameTime when future messages shall be processed.
@@ -469,8 +473,13 @@ void recvPlayerGameTime(NETQUEUE queue)
 	if (shouldCheckDebugSyncForPlayerSlot(queue.index))
 	{
 		syncDebug("GAME_GAME_TIME p%d;lat%u,ct%u,crc%04X,wlat%u", queue.index, latencyTicks, checkTime, checkCrc, wantedLatencies[queue.index]);
+		++syncStats.numChecked;
 		if (!checkDebugSync(checkTime, checkCrc))
 		{
+			if (syncStats.numMismatches++ == 0)
+			{
+				syncStats.firstMismatchTime = checkTime;
+			}
 			debug(LOG_ERROR, "Found CRC error when receiving GAME_GAME_TIME for player: %" PRIu8 " (checkTime: %" PRIu32 ", checkCrc: %" PRIu16 ")", queue.index, checkTime, checkCrc);
 			crcError = true;
 			if (NetPlay.players[queue.index].allocated)
@@ -205,4 +205,15 @@ void setPlayerGameTime(unsigned player, uint32_t time);   ///< Sets the player's
 
 bool gtimeShouldWaitForPlayer(unsigned player);
 
+/// Running tally of the game state CRCs sent and checked since gameTimeInit(). Used for verifying replays.
+struct GameTimeSyncStats
+{
+	uint32_t lastCheckTime = 0;      ///< gameTime of our most recent CRC.
+	uint32_t lastCheckCrc = 0;       ///< Our most recent CRC, as returned by nextDebugSync().
+	uint32_t numChecked = 0;         ///< Number of received CRCs compared against ours.
+	uint32_t numMismatches = 0;      ///< Number of received CRCs that didn't match ours.
+	uint32_t firstMismatchTime = 0;  ///< gameTime of the first mismatch, or 0 if none.
+};
+GameTimeSyncStats const &gameTimeGetSyncStats();
+
 #endif
@@ -307,6 +307,15 @@ static const std::map<SHADER_MODE, program_data> shader_to_file_table =
 			"ModelViewMatrix", "NormalMatrix", "colour", "teamcolour", "stretch", "ecmEffect", "alphaTest"
 		} }),
 
+	std::make_pair(SHADER_COMPONENT_INSTANCED, program_data{ "Instanced component program", "shaders/tcmask_instanced.vert", "shaders/tcmask_instanced.frag",
+		{
+			// per-frame global uniforms
+			"ProjectionMatrix", "lightPosition", "sceneColor", "ambient", "diffuse", "specular", "fogColor", "fogEnd", "fogStart", "graphicsCycle", "fogEnabled",
+			// per-mesh uniforms
+			"tcmask", "normalmap", "specularmap", "hasTangents"
+			// per-instance values are vertex attributes
+		} }),
+
 	std::make_pair(SHADER_BUTTON, program_data{ "Button program", "shaders/button.vert", "shaders/button.frag",
 		{
 			// per-frame global uniforms
@@ -923,6 +932,10 @@ void gl_pipeline_state_object::build_program(bool fragmentHighpFloatAvailable, b
 	glBindAttribLocation(program, 2, "vertexColor");
 	glBindAttribLocation(program, 3, "vertexNormal");
 	glBindAttribLocation(program, 4, "vertexTangent");
+	glBindAttribLocation(program, gfx_api::instance_modelview, "instanceModelViewMatrix");
+	glBindAttribLocation(program, gfx_api::instance_colour, "instanceColour");
+	glBindAttribLocation(program, gfx_api::instance_teamcolour, "instanceTeamColour");
+	glBindAttribLocation(program, gfx_api::instance_packed_values, "instancePackedValues");
 	ASSERT_OR_RETURN(, program, "Could not create shader program!");
 
 	char* vertexShaderContents = nullptr;
@@ -1431,6 +1444,11 @@ inline void gl_context::disableVertexAttribArray(GLuint index)
 	glDisableVertexAttribArray(index);
 	ASSERT(enabledVertexAttribIndexes.size() >= static_cast<size_t>(index), "Insufficient room in enabledVertexAttribIndexes for: %u", (unsigned int) index);
 	enabledVertexAttribIndexes[static_cast<size_t>(index)] = false;
+	if (index < vertexAttribDivisors.size() && vertexAttribDivisors[index] != 0)
+	{
+		// divisors are per-attribute state, so don't let a per-instance binding leak into the next pipeline
+		setVertexAttribDivisor(index, 0);
+	}
 }
 
 void gl_context::bind_vertex_buffers(const std::size_t& first, const std::vector<std::tuple<gfx_api::buffer*, std::size_t>>& vertex_buffers_offset)
@@ -1446,10 +1464,16 @@ void gl_context::bind_vertex_buffers(const std::size_t& first, const std::vector
 		}
 		ASSERT(buffer->usage == gfx_api::buffer::usage::vertex_buffer, "bind_vertex_buffers called with non-vertex-buffer");
 		buffer->bind();
+		const bool perInstance = buffer_desc.rate == gfx_api::vertex_input_rate::per_instance;
 		for (const auto& attribute : buffer_desc.attributes)
 		{
 			enableVertexAttribArray(static_cast<GLuint>(attribute.id));
 			glVertexAttribPointer(static_cast<GLuint>(attribute.id), get_size(attribute.type), get_type(attribute.type), get_normalisation(attribute.type), static_cast<GLsizei>(buffer_desc.stride), reinterpret_cast<void*>(attribute.offset + std::get<1>(vertex_buffers_offset[i])));
+			const GLuint divisor = (perInstance) ? 1 : 0;
+			if (vertexAttribDivisors[attribute.id] != divisor)
+			{
+				setVertexAttribDivisor(static_cast<GLuint>(attribute.id), divisor);
+			}
 		}
 	}
 }
@@ -1468,6 +1492,17 @@ void gl_context::unbind_vertex_buffers(const std::size_t& first, const std::vect
 	glBindBuffer(to_gl(gfx_api::buffer::usage::vertex_buffer), 0);
 }
 
+void gl_context::setVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	ASSERT_OR_RETURN(, instancedDrawsSupported, "Instanced draws are not supported");
+	ASSERT_OR_RETURN(, index < vertexAttribDivisors.size(), "Insufficient room in vertexAttribDivisors for: %u", (unsigned int) index);
+	if (vertexAttribDivisors[index] != divisor)
+	{
+		glVertexAttribDivisor(index, divisor);
+		vertexAttribDivisors[index] = divisor;
+	}
+}
+
 void gl_context::disable_all_vertex_buffers()
 {
 	for (GLuint index = 0; index < static_cast<GLuint>(enabledVertexAttribIndexes.size()); ++index)
@@ -1599,6 +1634,19 @@ void gl_context::draw_elements(const size_t& offset, const size_t &count, const
 	glDrawElements(to_gl(primitive), static_cast<GLsizei>(count), to_gl(index), reinterpret_cast<void*>(offset));
 }
 
+void gl_context::draw_elements_instanced(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index, const size_t& instance_count)
+{
+	ASSERT_OR_RETURN(, instancedDrawsSupported, "Instanced draws are not supported");
+	ASSERT(count <= static_cast<size_t>(std::numeric_limits<GLsizei>::max()), "count (%zu) exceeds GLsizei max", count);
+	ASSERT(instance_count <= static_cast<size_t>(std::numeric_limits<GLsizei>::max()), "instance_count (%zu) exceeds GLsizei max", instance_count);
+	glDrawElementsInstanced(to_gl(primitive), static_cast<GLsizei>(count), to_gl(index), reinterpret_cast<void*>(offset), static_cast<GLsizei>(instance_count));
+}
+
+bool gl_context::supports_instanced_draws() const
+{
+	return instancedDrawsSupported;
+}
+
 void gl_context::set_polygon_offset(const float& offset, const float& slope)
 {
 	glPolygonOffset(offset, slope);
@@ -2208,6 +2256,29 @@ bool gl_context::initGLContext()
 		glmaxVertexAttribs = 8;
 	}
 	enabledVertexAttribIndexes.resize(static_cast<size_t>(glmaxVertexAttribs), false);
+	vertexAttribDivisors.resize(static_cast<size_t>(glmaxVertexAttribs), 0);
+
+	// Instanced draws need glDrawElementsInstanced + glVertexAttribDivisor (core in OpenGL 3.3 / OpenGL ES 3.0),
+	// GLSL 1.50 / ES 3.00 for the instanced shaders, and enough attribute slots for the per-instance data
+	if (!gles)
+	{
+		// glad only loads the OpenGL 3.0 entry points (and has no GLAD_GL_VERSION_3_3), so check the context
+		// version ourselves and fetch the 3.3 entry points directly
+		GLint gl_majorversion = wz_GetGLIntegerv(GL_MAJOR_VERSION, 0);
+		GLint gl_minorversion = wz_GetGLIntegerv(GL_MINOR_VERSION, 0);
+		if (GLAD_GL_VERSION_3_0 && ((gl_majorversion > 3) || ((gl_majorversion == 3) && (gl_minorversion >= 3))))
+		{
+			glad_glDrawElementsInstanced = reinterpret_cast<PFNGLDRAWELEMENTSINSTANCEDPROC>(func_GLGetProcAddress("glDrawElementsInstanced"));
+			glad_glVertexAttribDivisor = reinterpret_cast<PFNGLVERTEXATTRIBDIVISORPROC>(func_GLGetProcAddress("glVertexAttribDivisor"));
+			instancedDrawsSupported = glDrawElementsInstanced != nullptr && glVertexAttribDivisor != nullptr;
+		}
+	}
+	else
+	{
+		instancedDrawsSupported = GLAD_GL_ES_VERSION_3_0 && glDrawElementsInstanced != nullptr && glVertexAttribDivisor != nullptr;
+	}
+	instancedDrawsSupported = instancedDrawsSupported && glmaxVertexAttribs > static_cast<GLint>(gfx_api::instance_packed_values);
+	debug(LOG_3D, "  * Instanced draws %s supported.", instancedDrawsSupported ? "are" : "are NOT");
 
 	if (khr_debug)
 	{
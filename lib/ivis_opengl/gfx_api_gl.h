@@ -200,6 +200,8 @@ struct gl_context final : public gfx_api::context
 	virtual void set_uniforms(const size_t& first, const std::vector<std::tuple<const void*, size_t>>& uniform_blocks) override;
 	virtual void draw(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive) override;
 	virtual void draw_elements(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index) override;
+	virtual void draw_elements_instanced(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index, const size_t& instance_count) override;
+	virtual bool supports_instanced_draws() const override;
 	virtual void set_polygon_offset(const float& offset, const float& slope) override;
 	virtual void set_depth_range(const float& min, const float& max) override;
 	virtual int32_t get_context_value(const context_value property) override;
@@ -228,10 +230,13 @@ private:
 	bool initGLContext();
 	void enableVertexAttribArray(GLuint index);
 	void disableVertexAttribArray(GLuint index);
+	void setVertexAttribDivisor(GLuint index, GLuint divisor);
 	std::string calculateFormattedRendererInfoString() const;
 	bool isBlocklistedGraphicsDriver() const;
 
 	std::vector<bool> enabledVertexAttribIndexes;
+	std::vector<GLuint> vertexAttribDivisors;
+	bool instancedDrawsSupported = false;
 	size_t frameNum = 0;
 	std::string formattedRendererInfoString;
 };
@@ -224,6 +224,16 @@ void null_context::draw_elements(const size_t& offset, const size_t &count, cons
 	// no-op
 }
 
+void null_context::draw_elements_instanced(const size_t& offset, const size_t &count, const gfx_api::primitive_type &primitive, const gfx_api::index_type& index, const size_t& instance_count)
+{
+	// no-op
+}
+
+bool null_context::supports_instanced_draws() const
+{
+	return true;
+}
+
 void null_context::set_polygon_offset(const float& offset, const float& slope)
 {
 	// no-op
@@ -797,6 +797,7 @@ struct shader_infos
 static const std::map<SHADER_MODE, shader_infos> spv_files
 {
 	std::make_pair(SHADER_COMPONENT, shader_infos{ "shaders/vk/tcmask.vert.spv", "shaders/vk/tcmask.frag.spv" }),
+	std::make_pair(SHADER_COMPONENT_INSTANCED, shader_infos{ "shaders/vk/tcmask_instanced.vert.spv", "shaders/vk/tcmask_instanced.frag.spv" }),
 	std::make_pair(SHADER_BUTTON, shader_infos{ "shaders/vk/button.vert.spv", "shaders/vk/button.frag.spv" }),
 	std::make_pair(SHADER_NOLIGHT, shader_infos{ "shaders/vk/nolight.vert.spv", "shaders/vk/nolight.frag.spv" }),
 	std::make_pair(SHADER_TERRAIN, shader_infos{ "shaders/vk/terrain.vert.spv", "shaders/vk/terrain.frag.spv" }),
@@ -1247,7 +1248,7 @@ VkPSO::VkPSO(vk::Device _dev,
 			vk::VertexInputBindingDescription()
 			.setBinding(buffer_id)
 			.setStride(static_cast<uint32_t>(buffer.stride))
-			.setInputRate(vk::VertexInputRate::eVertex)
+			.setInputRate((buffer.rate == gfx_api::vertex_input_rate::per_instance) ? vk::VertexInputRate::eInstance : vk::VertexInputRate::eVertex)
 		);
 		for (const auto& attribute : buffer.attributes)
 		{
@@ -1392,6 +1393,11 @@ void VkBuf::upload(const size_t & size, const void * data)
 {
 	ASSERT(size > 0, "Attempt to upload buffer of size 0");
 	allocateBufferObject(size);
+	if (data == nullptr)
+	{
+		// just create the data store (contents are undefined until updated)
+		return;
+	}
 	update(0, size, data);
 }
 
@@ -3113,6 +3119,21 @@ void VkRoot::draw_elements(const std::size_t& offset, const std::size_t& count,
 	buffering_mechanism::get_current_resources().cmdDraw.drawIndexed(static_cast<uint32_t>(count), 1, static_cast<uint32_t>(offset) >> 2, 0, 0, vkDynLoader);
 }
 
+void VkRoot::draw_elements_instanced(const std::size_t& offset, const std::size_t& count, const gfx_api::primitive_type&, const gfx_api::index_type& index, const std::size_t& instance_count)
+{
+	ASSERT_OR_RETURN(, currentPSO != nullptr, "currentPSO == NULL");
+	ASSERT(offset <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "offset (%zu) exceeds uint32_t max", offset);
+	ASSERT(count <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "count (%zu) exceeds uint32_t max", count);
+	ASSERT(instance_count <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "instance_count (%zu) exceeds uint32_t max", instance_count);
+	const uint32_t firstIndex = static_cast<uint32_t>(offset) / ((index == gfx_api::index_type::u16) ? 2 : 4);
+	buffering_mechanism::get_current_resources().cmdDraw.drawIndexed(static_cast<uint32_t>(count), static_cast<uint32_t>(instance_count), firstIndex, 0, 0, vkDynLoader);
+}
+
+bool VkRoot::supports_instanced_draws() const
+{
+	return true; // per-instance vertex input is core Vulkan 1.0
+}
+
 void VkRoot::bind_vertex_buffers(const std::size_t& first, const std::vector<std::tuple<gfx_api::buffer*, std::size_t>>& vertex_buffers_offset)
 {
 	ASSERT_OR_RETURN(, currentPSO != nullptr, "currentPSO == NULL");
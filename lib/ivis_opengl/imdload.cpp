@@ -36,6 +36,7 @@
 #include "lib/ivis_opengl/piematrix.h"
 #include "lib/ivis_opengl/pienormalize.h"
 #include "lib/ivis_opengl/piestate.h"
+#include "lib/ivis_opengl/piedef.h"
 
 #include "ivisdef.h" // for imd structures
 #include "imd.h" // for imd structures
@@ -63,6 +64,7 @@ iIMDShape::~iIMDShape()
 
 void modelShutdown()
 {
+	pie_ShadowCacheClear();
 	models.clear();
 }
 
@@ -59,4 +59,7 @@ void pie_RemainingPasses(uint64_t currentGameFrame);
 
 void pie_CleanUp();
 
+/** Drop all cached shadow volumes (they are keyed on iIMDShape pointers, so this must be called when models are freed). */
+void pie_ShadowCacheClear();
+
 #endif // _piedef_h
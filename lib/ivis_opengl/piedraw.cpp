@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include "lib/framework/frame.h"
+#include "lib/framework/wzapp.h"
 #include "lib/ivis_opengl/ivisdef.h"
 #include "lib/ivis_opengl/imd.h"
 #include "lib/ivis_opengl/piefunc.h"
@@ -41,6 +42,10 @@
 #include <vector>
 #include <algorithm>
 #include <unordered_set>
+#include <list>
+#include <atomic>
+#include <thread>
+#include <cmath>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -129,6 +134,8 @@ static std::vector<ShadowcastingShape> scshapes;
 static std::vector<SHAPE> tshapes;
 static std::vector<SHAPE> shapes;
 static gfx_api::buffer* pZeroedVertexBuffer = nullptr;
+static std::vector<gfx_api::Draw3DShapeInstanceData> instances;
+static gfx_api::buffer* pInstanceBuffer = nullptr;
 
 static gfx_api::buffer* getZeroedVertexBuffer(size_t size)
 {
@@ -242,15 +249,8 @@ private:
 	std::unordered_set<std::type_index> performed_once;
 };
 
-template<SHADER_MODE shader, typename AdditivePSO, typename AlphaPSO, typename PremultipliedPSO, typename OpaquePSO>
-static void draw3dShapeTemplated(const templatedState &lastState, ShaderOnce& globalsOnce, const PIELIGHT &colour, const PIELIGHT &teamcolour, const float& stretch, const int& ecmState, const float& timestate, const glm::mat4 & matrix, glm::vec4 &sceneColor, glm::vec4 &ambient, glm::vec4 &diffuse, glm::vec4 &specular, const iIMDShape * shape, int pieFlag, int frame)
+static gfx_api::Draw3DShapeGlobalUniforms getDraw3DShapeGlobalUniforms(const float& timestate, const glm::vec4 &sceneColor, const glm::vec4 &ambient, const glm::vec4 &diffuse, const glm::vec4 &specular)
 {
-	templatedState currentState = templatedState(shader, shape, pieFlag);
-
-	auto* tcmask = shape->tcmaskpage != iV_TEX_INVALID ? &pie_Texture(shape->tcmaskpage) : nullptr;
-	auto* normalmap = shape->normalpage != iV_TEX_INVALID ? &pie_Texture(shape->normalpage) : nullptr;
-	auto* specularmap = shape->specularpage != iV_TEX_INVALID ? &pie_Texture(shape->specularpage) : nullptr;
-
 	const auto &renderState = getCurrentRenderState();
 	const glm::vec4 fogColor = renderState.fogEnabled ? glm::vec4(
 		renderState.fogColour.vector[0] / 255.f,
@@ -259,11 +259,28 @@ static void draw3dShapeTemplated(const templatedState &lastState, ShaderOnce& gl
 		renderState.fogColour.vector[3] / 255.f
 	) : glm::vec4(0.f);
 
-	gfx_api::Draw3DShapeGlobalUniforms globalUniforms {
+	return gfx_api::Draw3DShapeGlobalUniforms {
 		pie_PerspectiveGet(),
 		glm::vec4(currentSunPosition, 0.f), sceneColor, ambient, diffuse, specular, fogColor,
 		renderState.fogBegin, renderState.fogEnd, timestate, renderState.fogEnabled
 	};
+}
+
+static inline glm::vec4 lighting0Vec4(LIGHTING_TYPE entry)
+{
+	return glm::vec4(lighting0[entry][0], lighting0[entry][1], lighting0[entry][2], lighting0[entry][3]);
+}
+
+template<SHADER_MODE shader, typename AdditivePSO, typename AlphaPSO, typename PremultipliedPSO, typename OpaquePSO>
+static void draw3dShapeTemplated(const templatedState &lastState, ShaderOnce& globalsOnce, const PIELIGHT &colour, const PIELIGHT &teamcolour, const float& stretch, const int& ecmState, const float& timestate, const glm::mat4 & matrix, glm::vec4 &sceneColor, glm::vec4 &ambient, glm::vec4 &diffuse, glm::vec4 &specular, const iIMDShape * shape, int pieFlag, int frame)
+{
+	templatedState currentState = templatedState(shader, shape, pieFlag);
+
+	auto* tcmask = shape->tcmaskpage != iV_TEX_INVALID ? &pie_Texture(shape->tcmaskpage) : nullptr;
+	auto* normalmap = shape->normalpage != iV_TEX_INVALID ? &pie_Texture(shape->normalpage) : nullptr;
+	auto* specularmap = shape->specularpage != iV_TEX_INVALID ? &pie_Texture(shape->specularpage) : nullptr;
+
+	gfx_api::Draw3DShapeGlobalUniforms globalUniforms = getDraw3DShapeGlobalUniforms(timestate, sceneColor, ambient, diffuse, specular);
 
 	gfx_api::Draw3DShapePerMeshUniforms meshUniforms {
 		tcmask ? 1 : 0, normalmap != nullptr, specularmap != nullptr, shape->buffers[VBO_TANGENT] != nullptr
@@ -381,10 +398,10 @@ static templatedState pie_Draw3DShape2(const templatedState &lastState, ShaderOn
 		pie_SetShaderEcmEffect(true);
 	}
 
-	glm::vec4 sceneColor(lighting0[LIGHT_EMISSIVE][0], lighting0[LIGHT_EMISSIVE][1], lighting0[LIGHT_EMISSIVE][2], lighting0[LIGHT_EMISSIVE][3]);
-	glm::vec4 ambient(lighting0[LIGHT_AMBIENT][0], lighting0[LIGHT_AMBIENT][1], lighting0[LIGHT_AMBIENT][2], lighting0[LIGHT_AMBIENT][3]);
-	glm::vec4 diffuse(lighting0[LIGHT_DIFFUSE][0], lighting0[LIGHT_DIFFUSE][1], lighting0[LIGHT_DIFFUSE][2], lighting0[LIGHT_DIFFUSE][3]);
-	glm::vec4 specular(lighting0[LIGHT_SPECULAR][0], lighting0[LIGHT_SPECULAR][1], lighting0[LIGHT_SPECULAR][2], lighting0[LIGHT_SPECULAR][3]);
+	glm::vec4 sceneColor = lighting0Vec4(LIGHT_EMISSIVE);
+	glm::vec4 ambient = lighting0Vec4(LIGHT_AMBIENT);
+	glm::vec4 diffuse = lighting0Vec4(LIGHT_DIFFUSE);
+	glm::vec4 specular = lighting0Vec4(LIGHT_SPECULAR);
 
 	frame %= std::max<int>(1, shape->numFrames);
 
@@ -459,112 +476,103 @@ inline void hash_combine(std::size_t& seed, const T& v, Rest... rest) {
 	hash_combine(seed, rest...);
 }
 
-std::size_t hash_vec4(const glm::vec4& vec)
-{
-	std::size_t h=0;
-	hash_combine(h, vec[0], vec[1], vec[2], vec[3]);
-	return h;
-}
+// Object-space light directions are snapped to 1/SHADOW_LIGHT_QUANTIZATION steps, so objects facing (almost) the same way share a shadow volume
+#define SHADOW_LIGHT_QUANTIZATION 64
+#define SHADOW_CACHE_MAX_ENTRIES 4096
+#define SHADOW_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define SHADOW_MIN_JOBS_FOR_WORKERS 4
+#define SHADOW_MAX_WORKERS 3
 
-struct ShadowDrawParameters {
+struct ShadowCacheKey {
+	const iIMDShape *shape;
 	int flag;
 	int flag_data;
-	//		glm::mat4 modelViewMatrix; // the modelViewMatrix doesn't change any of the vertex / buffer calculations
-	glm::vec4 light;
+	glm::ivec3 lightDirection; // quantized
+	int lightLength;
 
-	ShadowDrawParameters(int flag, int flag_data, const glm::vec4 &light)
-	: flag(flag)
+	ShadowCacheKey(const iIMDShape *shape, int flag, int flag_data, const glm::vec4 &light)
+	: shape(shape)
+	, flag(flag)
 	, flag_data(flag_data)
-	, light(light)
-	{ }
+	{
+		const glm::vec3 dir(light);
+		const float length = glm::length(dir);
+		lightLength = static_cast<int>(std::lround(length));
+		lightDirection = (length > 0.f) ? glm::ivec3(glm::round(dir / length * static_cast<float>(SHADOW_LIGHT_QUANTIZATION))) : glm::ivec3(0);
+	}
+
+	/// The light vector the cached shadow volume is extruded along
+	glm::vec3 quantizedLight() const
+	{
+		const glm::vec3 dir = glm::vec3(lightDirection);
+		const float length = glm::length(dir);
+		return (length > 0.f) ? dir / length * static_cast<float>(lightLength) : glm::vec3(0.f);
+	}
 
-	bool operator ==(const ShadowDrawParameters &b) const
+	bool operator ==(const ShadowCacheKey &b) const
 	{
-		return (flag == b.flag) && (flag_data == b.flag_data) && (light == b.light);
+		return (shape == b.shape) && (flag == b.flag) && (flag_data == b.flag_data) && (lightDirection == b.lightDirection) && (lightLength == b.lightLength);
 	}
 };
 
 namespace std {
 	template <>
-	struct hash<ShadowDrawParameters>
+	struct hash<ShadowCacheKey>
 	{
-		std::size_t operator()(const ShadowDrawParameters& k) const
+		std::size_t operator()(const ShadowCacheKey& k) const
 		{
 			std::size_t h = 0;
-			hash_combine(h, k.flag, k.flag_data, hash_vec4(k.light));
+			hash_combine(h, k.shape, k.flag, k.flag_data, k.lightDirection.x, k.lightDirection.y, k.lightDirection.z, k.lightLength);
 			return h;
 		}
 	};
 }
 
+/// Shadow volumes that persist across frames, each in its own static vertex buffer (in object space).
+/// Bounded by entry count and buffer bytes; least recently used entries are evicted first.
 struct ShadowCache {
 
 	struct CachedShadowData {
-		uint64_t lastQueriedFrameCount = 0;
-		std::vector<Vector3f> vertexes;
+		gfx_api::buffer *buffer = nullptr; // nullptr if the shape casts no silhouette for this light
+		size_t vertexCount = 0;
+		uint64_t lastUsedFrame = 0;
+		std::list<ShadowCacheKey>::iterator lruPosition;
 
 		CachedShadowData() { }
 	};
 
-	typedef std::unordered_map<ShadowDrawParameters, CachedShadowData> ShadowDrawParametersToCachedDataMap;
-	typedef std::unordered_map<iIMDShape *, ShadowDrawParametersToCachedDataMap, std::hash<iIMDShape *>> ShapeMap;
-
-	const CachedShadowData* findCacheForShadowDraw(iIMDShape *shape, int flag, int flag_data, const glm::vec4 &light)
+	CachedShadowData* find(const ShadowCacheKey &key)
 	{
-		auto it = shapeMap.find(shape);
-		if (it == shapeMap.end()) {
-			return nullptr;
-		}
-		auto it_cachedData = it->second.find(ShadowDrawParameters(flag, flag_data, light));
-		if (it_cachedData == it->second.end()) {
-			return nullptr;
-		}
-		// update the frame in which we requested this shadow cache
-		it_cachedData->second.lastQueriedFrameCount = _currentFrame;
-		return &(it_cachedData->second);
-	}
-
-	CachedShadowData& createCacheForShadowDraw(iIMDShape *shape, int flag, int flag_data, const glm::vec4 &light)
-	{
-		auto result = shapeMap[shape].emplace(ShadowDrawParameters(flag, flag_data, light), CachedShadowData());
-		result.first->second.lastQueriedFrameCount = _currentFrame;
-		return result.first->second;
-	}
-
-	void addPremultipliedVertexes(const CachedShadowData& cachedData, const glm::mat4 &modelViewMatrix)
-	{
-		float mat_a = modelViewMatrix[0].x;
-		float mat_b = modelViewMatrix[1].x;
-		float mat_c = modelViewMatrix[2].x;
-		float mat_d = modelViewMatrix[3].x;
-		float mat_e = modelViewMatrix[0].y;
-		float mat_f = modelViewMatrix[1].y;
-		float mat_g = modelViewMatrix[2].y;
-		float mat_h = modelViewMatrix[3].y;
-		float mat_i = modelViewMatrix[0].z;
-		float mat_j = modelViewMatrix[1].z;
-		float mat_k = modelViewMatrix[2].z;
-		float mat_l = modelViewMatrix[3].z;
-		float premult_x;
-		float premult_y;
-		float premult_z;
-		for (auto &vertex : cachedData.vertexes)
+		auto it = entries.find(key);
+		if (it == entries.end())
 		{
-			premult_x = vertex.x*mat_a + vertex.y*mat_b + vertex.z*mat_c + mat_d;
-			premult_y = vertex.x*mat_e + vertex.y*mat_f + vertex.z*mat_g + mat_h;
-			premult_z = vertex.x*mat_i + vertex.y*mat_j + vertex.z*mat_k + mat_l;
-			vertexes.push_back(Vector3f(premult_x, premult_y, premult_z));
+			return nullptr;
 		}
+		// move to the front of the LRU list
+		lru.splice(lru.begin(), lru, it->second.lruPosition);
+		it->second.lastUsedFrame = _currentFrame;
+		return &(it->second);
 	}
 
-	const std::vector<Vector3f>& getPremultipliedVertexes()
-	{
-		return vertexes;
-	}
-
-	void clearPremultipliedVertexes()
+	CachedShadowData& insert(const ShadowCacheKey &key, const std::vector<Vector3f> &vertexes)
 	{
-		vertexes.clear();
+		auto result = entries.emplace(key, CachedShadowData());
+		CachedShadowData &cache = result.first->second;
+		ASSERT(result.second, "Shadow volume is already cached");
+		if (result.second)
+		{
+			lru.push_front(key);
+			cache.lruPosition = lru.begin();
+		}
+		cache.lastUsedFrame = _currentFrame;
+		if (!vertexes.empty())
+		{
+			cache.buffer = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer);
+			cache.buffer->upload(vertexes.size() * sizeof(Vector3f), vertexes.data());
+			cache.vertexCount = vertexes.size();
+			bufferBytes += vertexes.size() * sizeof(Vector3f);
+		}
+		return cache;
 	}
 
 	void setCurrentFrame(uint64_t currentFrame)
@@ -572,152 +580,244 @@ struct ShadowCache {
 		_currentFrame = currentFrame;
 	}
 
-	size_t removeUnused()
+	/// Evict least recently used entries until the cache is within budget. Entries used this frame are never evicted.
+	size_t evict()
 	{
-		std::vector<ShapeMap::iterator> unusedShapes;
-		size_t oldItemsRemoved = 0;
-		for (auto it_shape = shapeMap.begin(); it_shape != shapeMap.end(); ++it_shape)
+		size_t removed = 0;
+		while (!lru.empty() && (entries.size() > SHADOW_CACHE_MAX_ENTRIES || bufferBytes > SHADOW_CACHE_MAX_BYTES))
 		{
-			std::vector<ShadowDrawParametersToCachedDataMap::iterator> unusedBuffersForShape;
-			for (auto it_shadowDrawParams = it_shape->second.begin(); it_shadowDrawParams != it_shape->second.end(); ++it_shadowDrawParams)
-			{
-				if (it_shadowDrawParams->second.lastQueriedFrameCount != _currentFrame)
-				{
-					unusedBuffersForShape.push_back(it_shadowDrawParams);
-				}
-			}
-			for (auto &item : unusedBuffersForShape)
-			{
-				it_shape->second.erase(item);
-				++oldItemsRemoved;
-			}
-			if (it_shape->second.empty())
+			auto it = entries.find(lru.back());
+			ASSERT_OR_RETURN(removed, it != entries.end(), "Shadow cache LRU list out of sync");
+			if (it->second.lastUsedFrame == _currentFrame)
 			{
-				// remove from the root shapeMap
-				unusedShapes.push_back(it_shape);
+				break;
 			}
+			release(it->second);
+			entries.erase(it);
+			lru.pop_back();
+			++removed;
 		}
-		for (auto &item : unusedShapes)
+		return removed;
+	}
+
+	void clear()
+	{
+		for (auto &entry : entries)
 		{
-			shapeMap.erase(item);
+			release(entry.second);
 		}
-		return oldItemsRemoved;
+		entries.clear();
+		lru.clear();
+		bufferBytes = 0;
 	}
+
 private:
+	void release(CachedShadowData &cache)
+	{
+		if (cache.buffer)
+		{
+			bufferBytes -= cache.vertexCount * sizeof(Vector3f);
+			delete cache.buffer;
+			cache.buffer = nullptr;
+		}
+	}
+
 	uint64_t _currentFrame = 0;
-	ShapeMap shapeMap;
-	std::vector<Vector3f> vertexes;
+	std::unordered_map<ShadowCacheKey, CachedShadowData> entries;
+	std::list<ShadowCacheKey> lru; // front = most recently used
+	size_t bufferBytes = 0;
 };
 
-enum DrawShadowResult {
-	DRAW_SUCCESS_CACHED,
-	DRAW_SUCCESS_UNCACHED
-};
+/// A shadow volume that is missing from the cache. Filled in by pie_BuildShadowVolume, possibly on a worker thread.
+struct ShadowJob {
+	ShadowCacheKey key;
+	const EDGE *staticEdges; // the shape's stored static silhouette, if any (read-only)
+	size_t staticEdgeCount;
+	std::vector<Vector3f> vertexes;
+	std::vector<EDGE> newStaticEdges; // silhouette to store in the shape, for pie_STATIC_SHADOW without a stored silhouette
 
-/// Draw the shadow for a shape
-/// Prequisite:
-///		Caller must call the following before all calls to pie_DrawShadow():
-///			const auto &program = pie_ActivateShader(SHADER_GENERIC_COLOR, pie_PerspectiveGet(), glm::vec4());
-///			glEnableVertexAttribArray(program.locVertex);
-///		and must call the following after all calls to pie_DrawShadow():
-///			glDisableVertexAttribArray(program.locVertex);
-///			pie_DeactivateShader();
-///		The only place this is currently called is pie_ShadowDrawLoop(), which handles this properly.
-static inline DrawShadowResult pie_DrawShadow(ShadowCache &shadowCache, iIMDShape *shape, int flag, int flag_data, const glm::vec4 &light, const glm::mat4 &modelViewMatrix)
-{
-	static std::vector<EDGE> edgelist;  // Static, to save allocations.
-	static std::vector<EDGE> edgelistFlipped;  // Static, to save allocations.
-	static std::vector<EDGE> edgelistFiltered;  // Static, to save allocations.
-	EDGE *drawlist = nullptr;
+	ShadowJob(const ShadowCacheKey &key, const EDGE *staticEdges, size_t staticEdgeCount)
+	: key(key)
+	, staticEdges(staticEdges)
+	, staticEdgeCount(staticEdgeCount)
+	{ }
+};
 
+/// Extract the silhouette of a shape as seen from the (quantized) light, and extrude it into a shadow volume.
+/// Only reads the shape, so it is safe to run concurrently for different jobs.
+static void pie_BuildShadowVolume(ShadowJob &job)
+{
+	thread_local std::vector<EDGE> edgelist;  // To save allocations.
+	thread_local std::vector<EDGE> edgelistFlipped;  // To save allocations.
+	thread_local std::vector<EDGE> edgelistFiltered;  // To save allocations.
+
+	const iIMDShape *shape = job.key.shape;
+	const int flag = job.key.flag;
+	const int flag_data = job.key.flag_data;
+	const glm::vec3 light = job.key.quantizedLight();
+	const Vector3f *pVertices = shape->pShadowPoints->data();
+	const EDGE *drawlist = nullptr;
 	size_t edge_count;
-	DrawShadowResult result;
 
-	// Find cached data (if available)
-	// Note: The modelViewMatrix is not used for calculating the sorted / filtered vertices, so it's not included
-	const ShadowCache::CachedShadowData *pCached = shadowCache.findCacheForShadowDraw(shape, flag, flag_data, light);
-	if (pCached == nullptr)
+	if (job.staticEdges)
 	{
-		const Vector3f *pVertices = shape->pShadowPoints->data();
-		if (flag & pie_STATIC_SHADOW && shape->shadowEdgeList)
-		{
-			drawlist = shape->shadowEdgeList;
-			edge_count = shape->nShadowEdges;
-		}
-		else
+		drawlist = job.staticEdges;
+		edge_count = job.staticEdgeCount;
+	}
+	else
+	{
+		edgelist.clear();
+		glm::vec3 p[3];
+		for (const iIMDPoly &poly : *(shape->pShadowPolys))
 		{
-			edgelist.clear();
-			glm::vec3 p[3];
-			for (const iIMDPoly &poly : *(shape->pShadowPolys))
+			for (int j = 0; j < 3; ++j)
 			{
-				for (int j = 0; j < 3; ++j)
-				{
-					uint32_t current = poly.pindex[j];
-					p[j] = glm::vec3(pVertices[current].x, scale_y(pVertices[current].y, flag, flag_data), pVertices[current].z);
-				}
-				if (glm::dot(glm::cross(p[2] - p[0], p[1] - p[0]), glm::vec3(light)) > 0.0f)
+				uint32_t current = poly.pindex[j];
+				p[j] = glm::vec3(pVertices[current].x, scale_y(pVertices[current].y, flag, flag_data), pVertices[current].z);
+			}
+			if (glm::dot(glm::cross(p[2] - p[0], p[1] - p[0]), light) > 0.0f)
+			{
+				for (int n = 0; n < 3; ++n)
 				{
-					for (int n = 0; n < 3; ++n)
-					{
-						// Add the edges
-						edgelist.push_back({poly.pindex[n], poly.pindex[(n + 1)%3]});
-					}
+					// Add the edges
+					edgelist.push_back({poly.pindex[n], poly.pindex[(n + 1)%3]});
 				}
 			}
+		}
 
-			// Remove duplicate pairs from the edge list. For example, in the list ((1 2), (2 6), (6 2), (3, 4)), remove (2 6) and (6 2).
-			edgelistFlipped = edgelist;
-			std::for_each(edgelistFlipped.begin(), edgelistFlipped.end(), flipEdge);
-			std::sort(edgelist.begin(), edgelist.end(), edgeLessThan);
-			std::sort(edgelistFlipped.begin(), edgelistFlipped.end(), edgeLessThan);
-			edgelistFiltered.resize(edgelist.size());
-			edgelistFiltered.erase(std::set_difference(edgelist.begin(), edgelist.end(), edgelistFlipped.begin(), edgelistFlipped.end(), edgelistFiltered.begin(), edgeLessThan), edgelistFiltered.end());
+		// Remove duplicate pairs from the edge list. For example, in the list ((1 2), (2 6), (6 2), (3, 4)), remove (2 6) and (6 2).
+		edgelistFlipped = edgelist;
+		std::for_each(edgelistFlipped.begin(), edgelistFlipped.end(), flipEdge);
+		std::sort(edgelist.begin(), edgelist.end(), edgeLessThan);
+		std::sort(edgelistFlipped.begin(), edgelistFlipped.end(), edgeLessThan);
+		edgelistFiltered.resize(edgelist.size());
+		edgelistFiltered.erase(std::set_difference(edgelist.begin(), edgelist.end(), edgelistFlipped.begin(), edgelistFlipped.end(), edgelistFiltered.begin(), edgeLessThan), edgelistFiltered.end());
 
-			drawlist = &edgelistFiltered[0];
-			edge_count = edgelistFiltered.size();
-			//debug(LOG_WARNING, "we have %i edges", edge_count);
+		drawlist = edgelistFiltered.data();
+		edge_count = edgelistFiltered.size();
 
-			if (flag & pie_STATIC_SHADOW)
-			{
-				// then store it in the imd
-				shape->nShadowEdges = edge_count;
-				shape->shadowEdgeList = (EDGE *)realloc(shape->shadowEdgeList, sizeof(EDGE) * shape->nShadowEdges);
-				std::copy(drawlist, drawlist + edge_count, shape->shadowEdgeList);
-			}
+		if (flag & pie_STATIC_SHADOW)
+		{
+			// the caller stores it in the imd
+			job.newStaticEdges.assign(edgelistFiltered.begin(), edgelistFiltered.end());
 		}
+	}
 
-		std::vector<Vector3f> vertexes;
-		vertexes.reserve(edge_count * 6);
-		for (size_t i = 0; i < edge_count; i++)
-		{
-			int a = drawlist[i].from, b = drawlist[i].to;
+	job.vertexes.clear();
+	job.vertexes.reserve(edge_count * 6);
+	for (size_t i = 0; i < edge_count; i++)
+	{
+		int a = drawlist[i].from, b = drawlist[i].to;
+
+		glm::vec3 v1(pVertices[b].x, scale_y(pVertices[b].y, flag, flag_data), pVertices[b].z);
+		glm::vec3 v3(pVertices[a].x + light[0], scale_y(pVertices[a].y, flag, flag_data) + light[1], pVertices[a].z + light[2]);
 
-			glm::vec3 v1(pVertices[b].x, scale_y(pVertices[b].y, flag, flag_data), pVertices[b].z);
-			glm::vec3 v3(pVertices[a].x + light[0], scale_y(pVertices[a].y, flag, flag_data) + light[1], pVertices[a].z + light[2]);
+		job.vertexes.push_back(v1);
+		job.vertexes.push_back(glm::vec3(pVertices[b].x + light[0], scale_y(pVertices[b].y, flag, flag_data) + light[1], pVertices[b].z + light[2])); //v2
+		job.vertexes.push_back(v3);
+
+		job.vertexes.push_back(v3);
+		job.vertexes.push_back(glm::vec3(pVertices[a].x, scale_y(pVertices[a].y, flag, flag_data), pVertices[a].z)); //v4
+		job.vertexes.push_back(v1);
+	}
+}
 
-			vertexes.push_back(v1);
-			vertexes.push_back(glm::vec3(pVertices[b].x + light[0], scale_y(pVertices[b].y, flag, flag_data) + light[1], pVertices[b].z + light[2])); //v2
-			vertexes.push_back(v3);
+/*
+ *	Shadow volume workers
+ *	A small pool of threads that share the shadow volumes missing from the cache in a frame with the render thread.
+ */
+
+static std::vector<ShadowJob> shadowJobs;
+static std::atomic<size_t> nextShadowJob(0);
+static std::vector<WZ_THREAD *> shadowWorkers;
+static WZ_SEMAPHORE *shadowWorkSemaphore = nullptr;
+static WZ_SEMAPHORE *shadowDoneSemaphore = nullptr;
+static std::atomic<bool> shadowWorkersQuit(false);
+
+static void pie_RunShadowJobs()
+{
+	for (size_t i = nextShadowJob++; i < shadowJobs.size(); i = nextShadowJob++)
+	{
+		pie_BuildShadowVolume(shadowJobs[i]);
+	}
+}
 
-			vertexes.push_back(v3);
-			vertexes.push_back(glm::vec3(pVertices[a].x, scale_y(pVertices[a].y, flag, flag_data), pVertices[a].z)); //v4
-			vertexes.push_back(v1);
+static int pie_ShadowWorkerThreadFunc(void *)
+{
+	while (true)
+	{
+		wzSemaphoreWait(shadowWorkSemaphore);
+		if (shadowWorkersQuit.load())
+		{
+			break;
 		}
+		pie_RunShadowJobs();
+		wzSemaphorePost(shadowDoneSemaphore);
+	}
+	return 0;
+}
 
-		ShadowCache::CachedShadowData& cache = shadowCache.createCacheForShadowDraw(shape, flag, flag_data, light);
-		cache.vertexes = std::move(vertexes);
-		result = DRAW_SUCCESS_UNCACHED;
-		pCached = &cache;
+static void pie_StartShadowWorkers()
+{
+	if (shadowWorkSemaphore != nullptr)
+	{
+		return;
 	}
-	else
+	shadowWorkSemaphore = wzSemaphoreCreate(0);
+	shadowDoneSemaphore = wzSemaphoreCreate(0);
+	shadowWorkersQuit = false;
+	const unsigned hardwareThreads = std::thread::hardware_concurrency();
+	const unsigned numWorkers = std::min<unsigned>((hardwareThreads > 1) ? hardwareThreads - 1 : 0, SHADOW_MAX_WORKERS);
+	for (unsigned i = 0; i < numWorkers; ++i)
 	{
-		result = DRAW_SUCCESS_CACHED;
+		WZ_THREAD *worker = wzThreadCreate(pie_ShadowWorkerThreadFunc, nullptr);
+		wzThreadStart(worker);
+		shadowWorkers.push_back(worker);
 	}
+	debug(LOG_3D, "Started %u shadow volume worker threads", numWorkers);
+}
 
-	// Aggregate the vertexes (pre-computed with the modelViewMatrix)
-	shadowCache.addPremultipliedVertexes(*pCached, modelViewMatrix);
+static void pie_StopShadowWorkers()
+{
+	if (shadowWorkSemaphore == nullptr)
+	{
+		return;
+	}
+	shadowWorkersQuit = true;
+	for (size_t i = 0; i < shadowWorkers.size(); ++i)
+	{
+		wzSemaphorePost(shadowWorkSemaphore);
+	}
+	for (WZ_THREAD *worker : shadowWorkers)
+	{
+		wzThreadJoin(worker);
+	}
+	shadowWorkers.clear();
+	wzSemaphoreDestroy(shadowWorkSemaphore);
+	wzSemaphoreDestroy(shadowDoneSemaphore);
+	shadowWorkSemaphore = nullptr;
+	shadowDoneSemaphore = nullptr;
+}
 
-	return result;
+/// Build all queued shadow volumes, on the worker threads if there are enough of them. Returns once every job is done.
+static void pie_BuildQueuedShadowVolumes()
+{
+	nextShadowJob = 0;
+	size_t wokenWorkers = 0;
+	if (shadowJobs.size() >= SHADOW_MIN_JOBS_FOR_WORKERS)
+	{
+		pie_StartShadowWorkers();
+		wokenWorkers = std::min(shadowWorkers.size(), shadowJobs.size() - 1);
+		for (size_t i = 0; i < wokenWorkers; ++i)
+		{
+			wzSemaphorePost(shadowWorkSemaphore);
+		}
+	}
+	pie_RunShadowJobs();
+	for (size_t i = 0; i < wokenWorkers; ++i)
+	{
+		wzSemaphoreWait(shadowDoneSemaphore);
+	}
 }
 
 void pie_CleanUp()
@@ -725,11 +825,19 @@ void pie_CleanUp()
 	tshapes.clear();
 	shapes.clear();
 	scshapes.clear();
+	pie_StopShadowWorkers();
+	pie_ShadowCacheClear();
 	if (pZeroedVertexBuffer)
 	{
 		delete pZeroedVertexBuffer;
 		pZeroedVertexBuffer = nullptr;
 	}
+	instances.clear();
+	if (pInstanceBuffer)
+	{
+		delete pInstanceBuffer;
+		pInstanceBuffer = nullptr;
+	}
 }
 
 bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int pieFlag, int pieFlagData, const glm::mat4 &modelView)
@@ -804,65 +912,94 @@ bool pie_Draw3DShape(iIMDShape *shape, int frame, int team, PIELIGHT colour, int
 	return true;
 }
 
-static void pie_ShadowDrawLoop(ShadowCache &shadowCache)
+static ShadowCache shadowCache;
+
+static void pie_ShadowDrawLoop()
 {
+	static std::vector<ShadowCacheKey> keys;  // Static, to save allocations.
+	static std::unordered_map<ShadowCacheKey, size_t> queuedJobs;  // Static, to save allocations.
 	size_t cachedShadowDraws = 0;
 	size_t uncachedShadowDraws = 0;
-	for (unsigned i = 0; i < scshapes.size(); i++)
+
+	// Queue every shadow volume that isn't cached yet (once, even if several objects need it)
+	keys.clear();
+	shadowJobs.clear();
+	queuedJobs.clear();
+	for (const ShadowcastingShape &scshape : scshapes)
 	{
-		DrawShadowResult result = pie_DrawShadow(shadowCache, scshapes[i].shape, scshapes[i].flag, scshapes[i].flag_data, scshapes[i].light, scshapes[i].matrix);
-		if (result == DRAW_SUCCESS_CACHED)
+		keys.emplace_back(scshape.shape, scshape.flag, scshape.flag_data, scshape.light);
+		const ShadowCacheKey &key = keys.back();
+		if (shadowCache.find(key) != nullptr)
 		{
 			++cachedShadowDraws;
+			continue;
 		}
-		else
+		++uncachedShadowDraws;
+		if (queuedJobs.count(key) == 0)
 		{
-			++uncachedShadowDraws;
+			const bool useStaticEdges = (key.flag & pie_STATIC_SHADOW) && scshape.shape->shadowEdgeList;
+			queuedJobs.emplace(key, shadowJobs.size());
+			shadowJobs.emplace_back(key, useStaticEdges ? scshape.shape->shadowEdgeList : nullptr, useStaticEdges ? scshape.shape->nShadowEdges : 0);
 		}
 	}
 
-	const auto &premultipliedVertexes = shadowCache.getPremultipliedVertexes();
-	if (premultipliedVertexes.size() > 0)
+	// Extract the silhouettes (in parallel), then upload them on this thread
+	if (!shadowJobs.empty())
 	{
-		// Draw the shadow volume
-		gfx_api::DrawStencilShadow::get().bind();
-		// The vertexes returned by shadowCache.getPremultipliedVertexes() are pre-multiplied by the modelViewMatrix
-		// Thus we only need to include the perspective matrix
-		gfx_api::DrawStencilShadow::get().bind_constants({ pie_PerspectiveGet(), glm::vec2(0.f), glm::vec2(0.f), glm::vec4(0.f) });
-		gfx_api::context::get().bind_streamed_vertex_buffers(premultipliedVertexes.data(), sizeof(Vector3f) * premultipliedVertexes.size());
-
-		// Batch into glDrawArrays calls of <= SHADOW_BATCH_MAX
-		static const size_t SHADOW_BATCH_MAX = 8192 * 3; // must be divisible by 3
-		size_t vertex_count = premultipliedVertexes.size();
-		for (size_t startingIndex = 0; startingIndex < vertex_count; startingIndex += SHADOW_BATCH_MAX)
+		pie_BuildQueuedShadowVolumes();
+		for (ShadowJob &job : shadowJobs)
 		{
-			gfx_api::DrawStencilShadow::get().draw(std::min(vertex_count - startingIndex, SHADOW_BATCH_MAX), startingIndex);
+			iIMDShape *shape = const_cast<iIMDShape *>(job.key.shape);
+			if (!job.newStaticEdges.empty() && !shape->shadowEdgeList)
+			{
+				// store the static silhouette in the imd
+				shape->nShadowEdges = job.newStaticEdges.size();
+				shape->shadowEdgeList = (EDGE *)realloc(shape->shadowEdgeList, sizeof(EDGE) * shape->nShadowEdges);
+				std::copy(job.newStaticEdges.begin(), job.newStaticEdges.end(), shape->shadowEdgeList);
+			}
+			shadowCache.insert(job.key, job.vertexes);
 		}
-
-		gfx_api::context::get().disable_all_vertex_buffers();
+		shadowJobs.clear();
 	}
 
-	shadowCache.clearPremultipliedVertexes();
+	// Draw the shadow volumes - the cached vertexes are in object space, so each draw gets its own transform
+	gfx_api::DrawStencilShadow::get().bind();
+	const glm::mat4 &perspective = pie_PerspectiveGet();
+	for (size_t i = 0; i < scshapes.size(); ++i)
+	{
+		const ShadowCache::CachedShadowData *pCached = shadowCache.find(keys[i]);
+		if (pCached == nullptr || pCached->buffer == nullptr)
+		{
+			continue;
+		}
+		gfx_api::DrawStencilShadow::get().bind_constants({ perspective * scshapes[i].matrix, glm::vec2(0.f), glm::vec2(0.f), glm::vec4(0.f) });
+		gfx_api::DrawStencilShadow::get().bind_vertex_buffers(pCached->buffer);
+		gfx_api::DrawStencilShadow::get().draw(pCached->vertexCount, 0);
+	}
+	gfx_api::context::get().disable_all_vertex_buffers();
 
 //	debug(LOG_INFO, "Cached shadow draws: %lu, uncached shadow draws: %lu", cachedShadowDraws, uncachedShadowDraws);
 }
 
-static ShadowCache shadowCache;
-
 static void pie_DrawShadows(uint64_t currentGameFrame)
 {
 	const int width = pie_GetVideoBufferWidth();
 	const int height = pie_GetVideoBufferHeight();
 	shadowCache.setCurrentFrame(currentGameFrame);
 
-	pie_ShadowDrawLoop(shadowCache);
+	pie_ShadowDrawLoop();
 
 	PIELIGHT grey;
 	grey.byte = { 0, 0, 0, 128 };
 	pie_BoxFill_alpha(0, 0, width, height, grey);
 
 	scshapes.resize(0);
-	shadowCache.removeUnused();
+	shadowCache.evict();
+}
+
+void pie_ShadowCacheClear()
+{
+	shadowCache.clear();
 }
 
 struct less_than_shape
@@ -873,21 +1010,121 @@ struct less_than_shape
 	}
 };
 
+static inline int shapeFrame(const SHAPE &shape)
+{
+	return shape.frame % std::max<int>(1, shape.shape->numFrames);
+}
+
+// Groups identical meshes (same shape and animation frame) so each group can be drawn with one instanced draw call
+struct less_than_shape_frame
+{
+	inline bool operator() (const SHAPE& shape1, const SHAPE& shape2)
+	{
+		if (shape1.shape != shape2.shape)
+		{
+			return shape1.shape < shape2.shape;
+		}
+		return shapeFrame(shape1) < shapeFrame(shape2);
+	}
+};
+
 static ShaderOnce perFrameUniformsShaderOnce;
 
+/// Draws the (already sorted) opaque shapes, issuing one instanced draw call per run of identical mesh + frame.
+/// All per-object state is streamed in a single per-frame instance buffer.
+static void pie_DrawOpaqueShapesInstanced()
+{
+	using PSO = gfx_api::Draw3DShapeInstancedOpaque;
+
+	if (shapes.empty())
+	{
+		return;
+	}
+
+	instances.clear();
+	instances.reserve(shapes.size());
+	for (SHAPE const &shape : shapes)
+	{
+		instances.push_back(gfx_api::Draw3DShapeInstanceData {
+			shape.matrix, shape.colour.rgba, shape.teamcolour.rgba,
+			glm::vec4(shape.stretch, (shape.flag & pie_ECM) ? 1.f : 0.f, 1.f, 0.f)
+		});
+	}
+	if (!pInstanceBuffer)
+	{
+		pInstanceBuffer = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer, gfx_api::context::buffer_storage_hint::stream_draw);
+	}
+	pInstanceBuffer->upload(instances.size() * sizeof(gfx_api::Draw3DShapeInstanceData), instances.data());
+
+	// opaque shapes are always drawn lit and with fog
+	pie_SetFogStatus(true);
+	const gfx_api::Draw3DShapeGlobalUniforms globalUniforms = getDraw3DShapeGlobalUniforms(pie_GetShaderTime(), lighting0Vec4(LIGHT_EMISSIVE), lighting0Vec4(LIGHT_AMBIENT), lighting0Vec4(LIGHT_DIFFUSE), lighting0Vec4(LIGHT_SPECULAR));
+
+	PSO::get().bind();
+	PSO::get().set_uniforms_at(0, globalUniforms);
+
+	const iIMDShape *lastShape = nullptr;
+	for (size_t first = 0, end = shapes.size(); first < end; )
+	{
+		const iIMDShape *shape = shapes[first].shape;
+		const int frame = shapeFrame(shapes[first]);
+		size_t last = first + 1;
+		while (last < end && shapes[last].shape == shape && shapeFrame(shapes[last]) == frame)
+		{
+			++last;
+		}
+
+		if (shape != lastShape)
+		{
+			auto* tcmask = shape->tcmaskpage != iV_TEX_INVALID ? &pie_Texture(shape->tcmaskpage) : nullptr;
+			auto* normalmap = shape->normalpage != iV_TEX_INVALID ? &pie_Texture(shape->normalpage) : nullptr;
+			auto* specularmap = shape->specularpage != iV_TEX_INVALID ? &pie_Texture(shape->specularpage) : nullptr;
+			gfx_api::buffer* pTangentBuffer = (shape->buffers[VBO_TANGENT] != nullptr) ? shape->buffers[VBO_TANGENT] : getZeroedVertexBuffer(shape->vertexCount * 4 * sizeof(gfx_api::gfxFloat));
+
+			gfx_api::Draw3DShapePerMeshUniforms meshUniforms {
+				tcmask ? 1 : 0, normalmap != nullptr, specularmap != nullptr, shape->buffers[VBO_TANGENT] != nullptr
+			};
+			PSO::get().set_uniforms_at(1, meshUniforms);
+			gfx_api::context::get().bind_index_buffer(*shape->buffers[VBO_INDEX], gfx_api::index_type::u16);
+			gfx_api::context::get().bind_vertex_buffers(0, {
+				std::make_tuple(shape->buffers[VBO_VERTEX], 0), std::make_tuple(shape->buffers[VBO_NORMAL], 0),
+				std::make_tuple(shape->buffers[VBO_TEXCOORD], 0), std::make_tuple(pTangentBuffer, 0)
+			});
+			PSO::get().bind_textures(&pie_Texture(shape->texpage), tcmask, normalmap, specularmap);
+			lastShape = shape;
+		}
+
+		const size_t instanceCount = last - first;
+		gfx_api::context::get().bind_vertex_buffers(4, { std::make_tuple(pInstanceBuffer, first * sizeof(gfx_api::Draw3DShapeInstanceData)) });
+		PSO::get().draw_elements_instanced(shape->polys.size() * 3, frame * shape->polys.size() * 3 * sizeof(uint16_t), instanceCount);
+		polyCount += shape->polys.size() * instanceCount;
+
+		first = last;
+	}
+}
+
 void pie_RemainingPasses(uint64_t currentGameFrame)
 {
 	perFrameUniformsShaderOnce.reset();
 
 	// Draw models
-	// sort list to reduce state changes
-	std::sort(shapes.begin(), shapes.end(), less_than_shape());
 	gfx_api::context::get().debugStringMarker("Remaining passes - opaque models");
 	templatedState lastState;
-	for (SHAPE const &shape : shapes)
+	if (gfx_api::context::get().supports_instanced_draws())
 	{
-		pie_SetShaderStretchDepth(shape.stretch);
-		lastState = pie_Draw3DShape2(lastState, perFrameUniformsShaderOnce, shape.shape, shape.frame, shape.colour, shape.teamcolour, shape.flag, shape.flag_data, shape.matrix);
+		// sort list so identical meshes are adjacent and can be drawn as one instanced batch
+		std::sort(shapes.begin(), shapes.end(), less_than_shape_frame());
+		pie_DrawOpaqueShapesInstanced();
+	}
+	else
+	{
+		// sort list to reduce state changes
+		std::sort(shapes.begin(), shapes.end(), less_than_shape());
+		for (SHAPE const &shape : shapes)
+		{
+			pie_SetShaderStretchDepth(shape.stretch);
+			lastState = pie_Draw3DShape2(lastState, perFrameUniformsShaderOnce, shape.shape, shape.frame, shape.colour, shape.teamcolour, shape.flag, shape.flag_data, shape.matrix);
+		}
 	}
 	gfx_api::context::get().disable_all_vertex_buffers();
 	if (!shapes.empty())
@@ -93,6 +93,7 @@ enum SHADER_MODE
 {
 	SHADER_NONE,
 	SHADER_COMPONENT,
+	SHADER_COMPONENT_INSTANCED,
 	SHADER_BUTTON,
 	SHADER_NOLIGHT,
 	SHADER_TERRAIN,
@@ -54,29 +54,32 @@ unset(NETCODE_VERSION_MINOR)
 # Calculate the NETCODE version
 # Rules:
 # - tagged (release) builds are versioned as:
-#	- NETCODE_VERSION_MAJOR: 0x4000
+#	- NETCODE_VERSION_MAJOR: 0x4001
 #	- NETCODE_VERSION_MINOR: VCS_TAG_TAG_COUNT
 # - master branch builds are versioned as:
-#	- NETCODE_VERSION_MAJOR: 0x10a0
+#	- NETCODE_VERSION_MAJOR: 0x10a1
 #	- NETCODE_VERSION_MINOR: VCS_COMMIT_COUNT
 # - any other builds (other branches, forks, etc)
-#	- NETCODE_VERSION_MAJOR: 0x1000
+#	- NETCODE_VERSION_MAJOR: 0x1001
 #	- NETCODE_VERSION_MINOR: 1
+# Bump the major versions when the join handshake changes, so that builds
+# with the same tag / commit count but a different handshake refuse each other.
+# (0x4001 / 0x10a1 / 0x1001: the host sends the socket compression to use.)
 
 if(DEFINED VCS_TAG AND NOT "${VCS_TAG}" STREQUAL "")
 	# We're on an exact tag / tagged release
 	VALIDATE_INTEGER(VCS_TAG_TAG_COUNT)
-	set(NETCODE_VERSION_MAJOR "0x4000")
+	set(NETCODE_VERSION_MAJOR "0x4001")
 	set(NETCODE_VERSION_MINOR ${VCS_TAG_TAG_COUNT})
 else()
 	if("${VCS_BRANCH}" STREQUAL "master")
 		# master branch build
 		VALIDATE_INTEGER(VCS_COMMIT_COUNT)
-		set(NETCODE_VERSION_MAJOR "0x10a0")
+		set(NETCODE_VERSION_MAJOR "0x10a1")
 		set(NETCODE_VERSION_MINOR ${VCS_COMMIT_COUNT})
 	else()
 		# any other builds (other branches, forks, etc)
-		set(NETCODE_VERSION_MAJOR "0x1000")
+		set(NETCODE_VERSION_MAJOR "0x1001")
 		set(NETCODE_VERSION_MINOR 1)
 	endif()
 endif()
@@ -38,6 +38,7 @@
 #include <physfs.h>
 #include "lib/framework/physfs_ext.h"
 #include <cstring>
+#include <algorithm>
 #include <memory>
 #include <thread>
 #include <atomic>
@@ -105,6 +106,10 @@ bool netGameserverPortOverride = false;
 */
 #define NET_BUFFER_SIZE	(MaxMsgSize)	// Would be 16K
 
+/// Most (uncompressed) bytes read from any one player per frame. Whatever is left stays in the socket
+/// until the next frame, so a burst from one player can't stall the frame for everyone else.
+#define NET_RECV_BUDGET_PER_FRAME	(NET_BUFFER_SIZE * 8)
+
 #define UPNP_SUCCESS 1
 #define UPNP_ERROR_DEVICE_NOT_FOUND -1
 #define UPNP_ERROR_CONTROL_NOT_AVAILABLE -2
@@ -123,6 +128,7 @@ static void NETallowJoining();
 static void recvDebugSync(NETQUEUE queue);
 static bool onBanList(const char *ip);
 static void addToBanList(const char *ip, const char *name);
+static bool isLoopbackIP(const char *ip);
 static void NETfixPlayerCount();
 /*
  * Network globals, these are part of the new network API
@@ -254,6 +260,9 @@ static Socket *bsocket = nullptr;                  ///< Socket used to talk to t
 static Socket *connected_bsocket[MAX_CONNECTED_PLAYERS] = { nullptr };  ///< Sockets used to talk to clients (host only).
 static SocketSet *socket_set = nullptr;
 
+static uint32_t recvBudgetRealTime = 0;                           ///< realTime of the frame recvBytesThisFrame belongs to.
+static size_t recvBytesThisFrame[MAX_CONNECTED_PLAYERS] = { 0 };  ///< Bytes read from each player this frame.
+
 WZ_THREAD *upnpdiscover;
 
 static struct UPNPUrls urls;
@@ -1684,6 +1693,16 @@ size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal)
 	return nStatsLastSec.*statsType.*statisticType - nStatsSecondLastSec.*statsType.*statisticType;
 }
 
+// Writes the message header and data in one writeAll, so they are queued together and a partial failure can't
+// send a header without its data. The buffer is kept between calls (only used from the main thread), so this
+// doesn't allocate per message like rawDataDup() did.
+static ssize_t writeMessage(Socket *sock, NetMessage const &message, size_t *rawByteCount)
+{
+	static std::vector<uint8_t> rawData;
+	rawData.clear();
+	message.rawDataAppendToVector(rawData);
+	return writeAll(sock, rawData.data(), rawData.size(), rawByteCount);
+}
 
 // ////////////////////////////////////////////////////////////////////////
 // Send a message to a player, option to guarantee message
@@ -1726,16 +1745,9 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 			// We are the host, send directly to player.
 			if (sockets[player] != nullptr && player != queue.exclude)
 			{
-				uint8_t *rawData = message->rawDataDup();
-				if (!rawData)
-				{
-					debug(LOG_FATAL, "Failed to allocate raw data (message type: %" PRIu8 ", player: %d)", message->type, player);
-					abort();
-				}
 				ssize_t rawLen   = message->rawLen();
 				size_t compressedRawLen;
-				result = writeAll(sockets[player], rawData, rawLen, &compressedRawLen);
-				delete[] rawData;  // Done with the data.
+				result = writeMessage(sockets[player], *message, &compressedRawLen);
 
 				if (result == rawLen)
 				{
@@ -1762,11 +1774,9 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 		// We are a client, send directly to player, who happens to be the host.
 		if (bsocket)
 		{
-			uint8_t *rawData = message->rawDataDup();
 			ssize_t rawLen   = message->rawLen();
 			size_t compressedRawLen;
-			result = writeAll(bsocket, rawData, rawLen, &compressedRawLen);
-			delete[] rawData;  // Done with the data.
+			result = writeMessage(bsocket, *message, &compressedRawLen);
 
 			if (result == rawLen)
 			{
@@ -2716,6 +2726,20 @@ static void NETcheckPlayers()
 // Receive a message over the current connection. We return true if there
 // is a message for the higher level code to process, and false otherwise.
 // We should not block here.
+/// Throttle the sockets of players who have used up their receive budget for this frame, or (when !enable) none.
+/// Only done around the checkSockets() call in NETrecvNet(), so other users of the sockets are not affected.
+static void setRecvThrottling(bool enable)
+{
+	for (unsigned player = 0; player < MAX_CONNECTED_PLAYERS; ++player)
+	{
+		Socket *sock = NetPlay.isHost ? connected_bsocket[player] : (player == NetPlay.hostPlayer ? bsocket : nullptr);
+		if (sock != nullptr)
+		{
+			socketSetReadThrottled(sock, enable && recvBytesThisFrame[player] >= NET_RECV_BUDGET_PER_FRAME);
+		}
+	}
+}
+
 bool NETrecvNet(NETQUEUE *queue, uint8_t *type)
 {
 	const int status = upnp_status.load(); // hack fix for clang and c++11 - fixed in standard for c++14
@@ -2762,8 +2786,18 @@ bool NETrecvNet(NETQUEUE *queue, uint8_t *type)
 		NETcheckPlayers();		// make sure players are still alive & well
 	}
 
+	if (recvBudgetRealTime != realTime)
+	{
+		recvBudgetRealTime = realTime;
+		std::fill(std::begin(recvBytesThisFrame), std::end(recvBytesThisFrame), 0);
+	}
+
+	// Players who have used up their budget must not be reported ready by checkSockets, or data already
+	// inflated on their compressed socket would keep it from polling anyone else for the rest of the frame.
+	setRecvThrottling(true);
 	if (socket_set == nullptr || checkSockets(socket_set, NET_READ_TIMEOUT) <= 0)
 	{
+		setRecvThrottling(false);
 		goto checkMessages;
 	}
 
@@ -2787,6 +2821,7 @@ bool NETrecvNet(NETQUEUE *queue, uint8_t *type)
 		if (dataLen > 0)
 		{
 			// we received some data, add to buffer
+			recvBytesThisFrame[current] += dataLen;
 			NETinsertRawData(NETnetQueue(current), buffer, dataLen);
 		}
 		else if (*pSocket == nullptr)
@@ -2804,10 +2839,12 @@ bool NETrecvNet(NETQUEUE *queue, uint8_t *type)
 			else
 			{
 				// lobby errors were set in NET_fillBuffer()
+				setRecvThrottling(false);
 				return false;
 			}
 		}
 	}
+	setRecvThrottling(false);
 
 checkMessages:
 	for (current = 0; current < MAX_CONNECTED_PLAYERS; ++current)
@@ -3750,7 +3787,11 @@ static void NETallowJoining()
 					result = htonl(ERROR_NOERROR);
 					memcpy(&buffer, &result, sizeof(result));
 					writeAll(tmp_socket[i], &buffer, sizeof(result));
-					socketBeginCompression(tmp_socket[i]);
+
+					// Tell the client which compression to use for the rest of the connection.
+					uint8_t compression = isLoopbackIP(getSocketTextAddress(tmp_socket[i])) ? SOCKET_COMPRESSION_NONE : SOCKET_COMPRESSION_ZLIB;
+					writeAll(tmp_socket[i], &compression, sizeof(compression));
+					socketBeginCompression(tmp_socket[i], static_cast<SocketCompression>(compression));
 
 					// Connection is successful.
 					connectFailed = false;
@@ -4482,13 +4523,27 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername, bool a
 		return false;
 	}
 
+	// The host picks the compression for the rest of the connection.
+	uint8_t compression = SOCKET_COMPRESSION_COUNT;
+	if (readAll(tcp_socket, &compression, sizeof(compression), 1500) != sizeof(compression) || compression >= SOCKET_COMPRESSION_COUNT)
+	{
+		debug(LOG_ERROR, "Couldn't agree on compression with the host (got %u).", (unsigned)compression);
+
+		SocketSet_DelSocket(socket_set, tcp_socket);
+		socketClose(tcp_socket);
+		tcp_socket = nullptr;
+		deleteSocketSet(socket_set);
+		socket_set = nullptr;
+		return false;
+	}
+
 	// Allocate memory for a new socket
 	NetPlay.hostPlayer = NET_HOST_ONLY;
 	NETinitQueue(NETnetQueue(NET_HOST_ONLY));
 	// NOTE: tcp_socket = bsocket now!
 	bsocket = tcp_socket;
 	tcp_socket = nullptr;
-	socketBeginCompression(bsocket);
+	socketBeginCompression(bsocket, static_cast<SocketCompression>(compression));
 
 	uint8_t playerType = (!asSpectator) ? NET_JOIN_PLAYER : NET_JOIN_SPECTATOR;
 
@@ -5313,6 +5368,10 @@ static bool isLoopbackIP(const char *ip)
 	{
 		return true;
 	}
+	if (strncmp(ip, "::ffff:127.", 11) == 0)
+	{
+		return true;	// IPv4-mapped, as seen on the dual-stack listen socket
+	}
 	if (strcmp(ip, "::1") == 0)
 	{
 		return true;
@@ -25,6 +25,7 @@
 #include "netqueue.h"
 #include "netplay.h"
 
+#include <algorithm>
 #include <limits>
 #include <cstdint>
 
@@ -104,45 +105,48 @@ bool decode_uint32_t(uint8_t b, uint32_t &v, unsigned n)
 	return !isLastByte;
 }
 
-uint8_t *NetMessage::rawDataDup() const
-{
-#if SIZE_MAX > UINT32_MAX
-	ASSERT_OR_RETURN(nullptr, data.size() <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "Trying to duplicate a very large packet (%zu bytes). (Message type: %" PRIu8 ")", data.size(), type);
-#endif
-	uint32_t dataSizeU32 = static_cast<uint32_t>(data.size());
-	unsigned encodedLengthOfSize = encodedlength_uint32_t(dataSizeU32);
+// Upper bound on the number of popped message buffers kept around by each queue for reuse.
+static const size_t maxSpareDataBuffers = 64;
+// Popped message buffers larger than this are freed instead of being kept for reuse.
+static const size_t maxSpareDataCapacity = 16384;
 
-	uint8_t *ret = new uint8_t[1 + encodedLengthOfSize + dataSizeU32];
-
-	ret[0] = type;
-	uint32_t len = dataSizeU32;
-	for (unsigned n = 0; n < encodedLengthOfSize; ++n)
+unsigned encode_uint32_t(uint8_t *out, uint32_t v)
+{
+	unsigned n = 0;
+	while (encode_uint32_t(out[n], v, n))
 	{
-		encode_uint32_t(ret[n + 1], len, n);
+		++n;
 	}
+	return n + 1;
+}
 
-	std::copy(data.begin(), data.begin() + dataSizeU32, ret + 1 + encodedLengthOfSize);
-	return ret;
+unsigned decode_uint32_t(const uint8_t *in, uint32_t &v)
+{
+	v = 0;
+	unsigned n = 0;
+	while (decode_uint32_t(in[n], v, n))
+	{
+		++n;
+	}
+	return n + 1;
 }
 
-void NetMessage::rawDataAppendToVector(std::vector<uint8_t> &output) const
+size_t NetMessage::rawHeader(uint8_t (&header)[MaxRawHeaderLen]) const
 {
 #if SIZE_MAX > UINT32_MAX
-	ASSERT(data.size() <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "Trying to duplicate a very large packet (%zu bytes).", data.size());
+	ASSERT(data.size() <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "Trying to send a very large packet (%zu bytes). (Message type: %" PRIu8 ")", data.size(), type);
 #endif
-	uint32_t dataSizeU32 = static_cast<uint32_t>(data.size());
-
-	unsigned encodedLengthOfSize = encodedlength_uint32_t(dataSizeU32);
+	header[0] = type;
+	return 1 + encode_uint32_t(header + 1, static_cast<uint32_t>(data.size()));
+}
 
-	output.push_back(type);
-	uint32_t len = dataSizeU32;
-	for (unsigned n = 0; n < encodedLengthOfSize; ++n)
-	{
-		uint8_t b;
-		encode_uint32_t(b, len, n);
-		output.push_back(b);
-	}
+void NetMessage::rawDataAppendToVector(std::vector<uint8_t> &output) const
+{
+	uint8_t header[MaxRawHeaderLen];
+	size_t headerLen = rawHeader(header);
 
+	output.reserve(output.size() + headerLen + data.size());
+	output.insert(output.end(), header, header + headerLen);
 	output.insert(output.end(), data.begin(), data.end());
 }
 
@@ -154,10 +158,22 @@ size_t NetMessage::rawLen() const
 NetQueue::NetQueue()
 	: canGetMessagesForNet(true)
 	, canGetMessages(true)
+	, dataPos(0)
+	, messagePos(0)
 	, pendingGameTimeUpdateMessages(0)
 {
-	dataPos = messages.end();
-	messagePos = messages.end();
+}
+
+std::vector<uint8_t> NetQueue::takeSpareData()
+{
+	if (spareData.empty())
+	{
+		return std::vector<uint8_t>();
+	}
+	std::vector<uint8_t> ret = std::move(spareData.back());
+	spareData.pop_back();
+	ret.clear();
+	return ret;
 }
 
 void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
@@ -165,31 +181,39 @@ void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
 	size_t used = 0;
 	std::vector<uint8_t> &buffer = incompleteReceivedMessageData;  // Short alias.
 
-	// Insert the data.
-	buffer.insert(buffer.end(), netData, netData + netLen);
+	// Parse straight from the network data, unless there is a partial message left over from last time.
+	const uint8_t *data = netData;
+	size_t size = netLen;
+	if (!buffer.empty())
+	{
+		buffer.insert(buffer.end(), netData, netData + netLen);
+		data = buffer.data();
+		size = buffer.size();
+	}
 
 	// Extract the messages.
-	while (buffer.size() - used > 1)
+	while (size - used > 1)
 	{
-		uint8_t type = buffer[used];
+		uint8_t type = data[used];
 
 		uint32_t len = 0;
 		bool moreBytes = true;
 		unsigned n;
-		for (n = 0; moreBytes && buffer.size() - used > 1 + n; ++n)
+		for (n = 0; moreBytes && size - used > 1 + n; ++n)
 		{
-			moreBytes = decode_uint32_t(buffer[used + 1 + n], len, n);
+			moreBytes = decode_uint32_t(data[used + 1 + n], len, n);
 		}
 		unsigned headerLen = 1 + n;
 
 		ASSERT(len < 40000000, "Trying to write a very large packet (%u bytes) to the queue.", len);
-		if (buffer.size() - used - headerLen < len)
+		if (moreBytes || size - used - headerLen < len)
 		{
 			break;  // Don't have a whole message ready yet.
 		}
 
-		messages.push_front(NetMessage(type));
-		messages.front().data.assign(buffer.begin() + used + headerLen, buffer.begin() + used + headerLen + len);
+		messages.emplace_back(type);
+		messages.back().data = takeSpareData();
+		messages.back().data.assign(data + used + headerLen, data + used + headerLen + len);
 		if (type == GAME_GAME_TIME)
 		{
 			++pendingGameTimeUpdateMessages;
@@ -197,8 +221,15 @@ void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
 		used += headerLen + len;
 	}
 
-	// Recycle old data.
-	buffer.erase(buffer.begin(), buffer.begin() + used);
+	// Keep any partial message for next time.
+	if (data == netData)
+	{
+		buffer.assign(netData + used, netData + netLen);
+	}
+	else
+	{
+		buffer.erase(buffer.begin(), buffer.begin() + used);
+	}
 }
 
 void NetQueue::setWillNeverGetMessagesForNet()
@@ -208,22 +239,17 @@ void NetQueue::setWillNeverGetMessagesForNet()
 
 unsigned NetQueue::numMessagesForNet() const
 {
-	unsigned count = 0;
-	if (canGetMessagesForNet)
+	if (!canGetMessagesForNet)
 	{
-		for (List::iterator i = dataPos; i != messages.begin(); --i)
-		{
-			++count;
-		}
+		return 0;
 	}
-
-	return count;
+	return static_cast<unsigned>(messages.size() - dataPos);
 }
 
 const NetMessage &NetQueue::getMessageForNet() const
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for getMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to get!");
+	ASSERT(dataPos != messages.size(), "No message to get!");
 
 	// Return the message.
 	return internal_getMessageForNet();
@@ -232,9 +258,9 @@ const NetMessage &NetQueue::getMessageForNet() const
 void NetQueue::popMessageForNet()
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for popMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to pop!");
+	ASSERT(dataPos != messages.size(), "No message to pop!");
 
-	if (messagePos != messages.begin() && internal_getMessageForNet().type == GAME_GAME_TIME)
+	if (messagePos != messages.size() && internal_getMessageForNet().type == GAME_GAME_TIME)
 	{
 		if (pendingGameTimeUpdateMessages > 0)
 		{
@@ -243,7 +269,7 @@ void NetQueue::popMessageForNet()
 	}
 
 	// Pop the message.
-	--dataPos;
+	++dataPos;
 
 	// Recycle old data.
 	popOldMessages();
@@ -255,7 +281,9 @@ void NetQueue::pushMessage(const NetMessage &message)
 	{
 		++pendingGameTimeUpdateMessages;
 	}
-	messages.push_front(message);
+	messages.emplace_back(message.type);
+	messages.back().data = takeSpareData();
+	messages.back().data.assign(message.data.begin(), message.data.end());
 }
 
 void NetQueue::setWillNeverGetMessages()
@@ -266,13 +294,13 @@ void NetQueue::setWillNeverGetMessages()
 bool NetQueue::haveMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for haveMessage.");
-	return messagePos != messages.begin();
+	return messagePos != messages.size();
 }
 
 const NetMessage &NetQueue::getMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for getMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to get!");
+	ASSERT(messagePos != messages.size(), "No message to get!");
 
 	// Return the message.
 	return internal_getMessage();
@@ -281,9 +309,9 @@ const NetMessage &NetQueue::getMessage() const
 void NetQueue::popMessage()
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for popMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to pop!");
+	ASSERT(messagePos != messages.size(), "No message to pop!");
 
-	if (messagePos != messages.begin() && internal_getMessage().type == GAME_GAME_TIME)
+	if (messagePos != messages.size() && internal_getMessage().type == GAME_GAME_TIME)
 	{
 		if (pendingGameTimeUpdateMessages > 0)
 		{
@@ -292,7 +320,7 @@ void NetQueue::popMessage()
 	}
 
 	// Pop the message.
-	--messagePos;
+	++messagePos;
 
 	// Recycle old data.
 	popOldMessages();
@@ -302,27 +330,23 @@ void NetQueue::popOldMessages()
 {
 	if (!canGetMessagesForNet)
 	{
-		dataPos = messages.begin();
+		dataPos = messages.size();
 	}
 	if (!canGetMessages)
 	{
-		messagePos = messages.begin();
-	}
-
-	List::iterator i = messages.end();
-	while (i != dataPos && i != messagePos)
-	{
-		--i;
+		messagePos = messages.size();
 	}
 
-	if (i == dataPos)
+	size_t numOld = std::min(dataPos, messagePos);
+	for (size_t n = 0; n < numOld; ++n)
 	{
-		dataPos = messages.end();  // Old iterator will become invalid.
-	}
-	if (i == messagePos)
-	{
-		messagePos = messages.end();  // Old iterator will become invalid.
+		std::vector<uint8_t> &oldData = messages.front().data;
+		if (spareData.size() < maxSpareDataBuffers && oldData.capacity() <= maxSpareDataCapacity)
+		{
+			spareData.push_back(std::move(oldData));
+		}
+		messages.pop_front();
 	}
-
-	messages.erase(i, messages.end());
+	dataPos -= numOld;
+	messagePos -= numOld;
 }
@@ -25,8 +25,8 @@
 #define _NET_QUEUE_H_
 
 #include "lib/framework/frame.h"
+#include <algorithm>
 #include <vector>
-#include <list>
 #include <deque>
 #include <unordered_map>
 
@@ -45,10 +45,12 @@
 class NetMessage
 {
 public:
+	enum { MaxRawHeaderLen = 6 };  ///< Type byte plus at most 5 bytes of encoded length.
+
 	NetMessage(uint8_t type_ = 0xFF) : type(type_) {}
-	uint8_t *rawDataDup() const;  ///< Returns data compatible with NetQueue::writeRawData(). Must be delete[]d.
+	size_t rawHeader(uint8_t (&header)[MaxRawHeaderLen]) const;  ///< Writes the type and encoded length to header, and returns the header length. The header followed by data is compatible with NetQueue::writeRawData().
 	void rawDataAppendToVector(std::vector<uint8_t> &output) const;  ///< Appends data compatible with NetQueue::writeRawData() to the input vector.
-	size_t rawLen() const;        ///< Returns the length of the return value of rawDataDup().
+	size_t rawLen() const;        ///< Returns the length of the header plus the length of the data.
 	uint8_t type;
 	std::vector<uint8_t> data;
 };
@@ -65,6 +67,20 @@ public:
 	{
 		message->data.push_back(v);
 	}
+	void bytes(const uint8_t *v, size_t len) const
+	{
+		message->data.insert(message->data.end(), v, v + len);
+	}
+	uint8_t *reserveBytes(size_t len) const  ///< Appends len bytes to be filled in by the caller, and returns a pointer to them. Any unused bytes must be returned with unreserveBytes().
+	{
+		size_t oldSize = message->data.size();
+		message->data.resize(oldSize + len);
+		return message->data.data() + oldSize;
+	}
+	void unreserveBytes(size_t len) const
+	{
+		message->data.resize(message->data.size() - len);
+	}
 	bool valid() const
 	{
 		return true;
@@ -84,6 +100,25 @@ public:
 		v = index >= message->data.size() ? 0x00 : message->data[index];
 		++index;
 	}
+	void bytes(uint8_t *v, size_t len) const
+	{
+		size_t available = index < message->data.size() ? std::min(len, message->data.size() - index) : 0;
+		if (available > 0)
+		{
+			std::copy_n(message->data.data() + index, available, v);
+		}
+		std::fill(v + available, v + len, 0x00);
+		index += len;
+	}
+	const uint8_t *peekBytes(size_t &available) const  ///< Returns a pointer to the unread data, and sets available to the number of unread bytes.
+	{
+		available = index < message->data.size() ? message->data.size() - index : 0;
+		return message->data.data() + std::min(index, message->data.size());
+	}
+	void skipBytes(size_t len) const
+	{
+		index += len;
+	}
 	bool valid() const
 	{
 		return index <= message->data.size();
@@ -126,30 +161,26 @@ public:
 
 private:
 	void popOldMessages();                                             ///< Pops any messages that are no longer needed.
+	std::vector<uint8_t> takeSpareData();                              ///< Returns an empty buffer, reusing the storage of a popped message if possible.
 
 	bool canGetMessagesForNet;                                         ///< True if we will send the messages over the network, false if we don't.
 	bool canGetMessages;                                               ///< True if we will get the messages, false if we don't use them ourselves.
 
 	inline const NetMessage &internal_getMessageForNet() const
 	{
-		// Return the message.
-		List::iterator i = dataPos;
-		--i;
-		return *i;
+		return messages[dataPos];
 	};
 
 	inline const NetMessage &internal_getMessage() const
 	{
-		// Return the message.
-		List::iterator i = messagePos;
-		--i;
-		return *i;
+		return messages[messagePos];
 	};
 
-	using List = std::list<NetMessage>;
-	List::iterator                dataPos;                             ///< Last message which was sent over the network.
-	List::iterator                messagePos;                          ///< Last message which was popped.
-	List                          messages;                            ///< List of messages. Messages are added to the front and read from the back.
+	using List = std::deque<NetMessage>;
+	size_t                        dataPos;                             ///< Index of the next message to send over the network.
+	size_t                        messagePos;                          ///< Index of the next message to return.
+	List                          messages;                            ///< List of messages. Messages are added to the back and removed from the front, once both sent and read.
+	std::vector<std::vector<uint8_t>> spareData;                       ///< Storage of popped messages, reused for new messages so that a busy queue does not allocate per message.
 	std::vector<uint8_t>          incompleteReceivedMessageData;       ///< Data from network which has not yet formed an entire message.
 	size_t                        pendingGameTimeUpdateMessages;       ///< Pending GAME_GAME_TIME messages added to this queue
 };
@@ -179,5 +210,9 @@ bool encode_uint32_t(uint8_t &b, uint32_t &v, unsigned n);
 /// Must init v to 0, does not modify b.
 /// Input is b, output is v.
 bool decode_uint32_t(uint8_t b, uint32_t &v, unsigned n);
+/// Encodes v to out, which must have room for 5 bytes, and returns the number of bytes written.
+unsigned encode_uint32_t(uint8_t *out, uint32_t v);
+/// Decodes v from in, which must have at least 5 readable bytes, and returns the number of bytes read.
+unsigned decode_uint32_t(const uint8_t *in, uint32_t &v);
 
 #endif //_NET_QUEUE_H_
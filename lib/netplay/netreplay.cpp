@@ -41,8 +41,10 @@
 #  pragma GCC diagnostic pop
 #endif
 
+#include <algorithm>
 #include <ctime>
 #include <memory>
+#include <zlib.h>
 
 #include "netreplay.h"
 #include "netplay.h"
@@ -53,10 +55,18 @@ static PHYSFS_file *replaySaveHandle = nullptr;
 static PHYSFS_file *replayLoadHandle = nullptr;
 
 static const uint32_t magicReplayNumber = 0x575A7270;  // "WZrp"
-static const uint32_t currentReplayFormatVer = 2;
+static const uint32_t currentReplayFormatVer = 3;
+static const uint32_t FirstCompressedReplayFormatVer = 3;  ///< From this version, the message stream is written as zlib-compressed chunks.
+static const uint32_t MaxReplayChunkSize = 256 * 1024 * 1024;
 static const size_t DefaultReplayBufferSize = 32768;
 static const size_t MaxReplayBufferSize = 2 * 1024 * 1024;
 
+static uint32_t replayLoadFormatVer = 0;
+
+// Decompressed chunk being read, while loading.
+static std::vector<uint8_t> replayLoadChunk;
+static size_t replayLoadChunkPos = 0;
+
 typedef std::vector<uint8_t> SerializedNetMessagesBuffer;
 static moodycamel::BlockingReaderWriterQueue<SerializedNetMessagesBuffer> serializedBufferWriteQueue(256);
 static SerializedNetMessagesBuffer latestWriteBuffer;
@@ -70,16 +80,56 @@ static void replaySaveThreadFunc(PHYSFS_file *pSaveHandle)
 	{
 		return;
 	}
+	// v3: Each chunk is written as its compressed size, its uncompressed size, then the zlib data, so loading can decompress a chunk at a time.
 	SerializedNetMessagesBuffer item;
+	std::vector<uint8_t> compressed;
+	bool truncated = false;
 	while (true)
 	{
 		serializedBufferWriteQueue.wait_dequeue(item);
 		if (item.empty())
 		{
 			// end chunk - we're done
+			PHYSFS_writeUBE32(pSaveHandle, 0);
+			PHYSFS_writeUBE32(pSaveHandle, 0);
 			break;
 		}
-		WZ_PHYSFS_writeBytes(pSaveHandle, item.data(), item.size());
+		if (truncated)
+		{
+			continue;  // Keep draining the queue until the end chunk, so the replay still ends cleanly.
+		}
+
+		uLongf compressedSize = compressBound(static_cast<uLong>(item.size()));
+		compressed.resize(compressedSize);
+		if (compress2(compressed.data(), &compressedSize, item.data(), static_cast<uLong>(item.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+		{
+			// Fall back to stored (level 0) blocks, which the loader's uncompress() reads just the same.
+			compressedSize = compressBound(static_cast<uLong>(item.size()));
+			if (compress2(compressed.data(), &compressedSize, item.data(), static_cast<uLong>(item.size()), Z_NO_COMPRESSION) != Z_OK)
+			{
+				// Skipping just this chunk would corrupt the message stream, so stop writing it here.
+				debug(LOG_ERROR, "Failed to compress replay chunk, replay will be truncated");
+				truncated = true;
+				continue;
+			}
+		}
+
+		PHYSFS_writeUBE32(pSaveHandle, static_cast<uint32_t>(compressedSize));
+		PHYSFS_writeUBE32(pSaveHandle, static_cast<uint32_t>(item.size()));
+		WZ_PHYSFS_writeBytes(pSaveHandle, compressed.data(), static_cast<PHYSFS_uint32>(compressedSize));
+	}
+}
+
+static void appendMessageToWriteBuffer(NetMessage const *message, uint8_t player)
+{
+	latestWriteBuffer.push_back(player);
+	message->rawDataAppendToVector(latestWriteBuffer);
+
+	if (latestWriteBuffer.size() >= minBufferSizeToQueue)
+	{
+		serializedBufferWriteQueue.enqueue(std::move(latestWriteBuffer));
+		latestWriteBuffer = std::vector<uint8_t>();
+		latestWriteBuffer.reserve(minBufferSizeToQueue);
 	}
 }
 
@@ -208,8 +258,7 @@ bool NETreplaySaveStop()
 
 	// v2: Append the "REPLAY_ENDED" message (from hostPlayer)
 	auto replayEndedMessage = NetMessage(REPLAY_ENDED);
-	latestWriteBuffer.push_back(NetPlay.hostPlayer);
-	replayEndedMessage.rawDataAppendToVector(latestWriteBuffer);
+	appendMessageToWriteBuffer(&replayEndedMessage, NetPlay.hostPlayer);
 
 	// Queue the last chunk for writing
 	if (!latestWriteBuffer.empty())
@@ -263,15 +312,7 @@ void NETreplaySaveNetMessage(NetMessage const *message, uint8_t player)
 
 	if (message->type > GAME_MIN_TYPE && message->type < GAME_MAX_TYPE)
 	{
-		latestWriteBuffer.push_back(player);
-		message->rawDataAppendToVector(latestWriteBuffer);
-
-		if (latestWriteBuffer.size() >= minBufferSizeToQueue)
-		{
-			serializedBufferWriteQueue.enqueue(std::move(latestWriteBuffer));
-			latestWriteBuffer = std::vector<uint8_t>();
-			latestWriteBuffer.reserve(minBufferSizeToQueue);
-		}
+		appendMessageToWriteBuffer(message, player);
 	}
 }
 
@@ -317,6 +358,7 @@ bool NETreplayLoadStart(std::string const &filename, ReplayOptionsHandler& optio
 
 		uint32_t replayFormatVer = settings.at("replayFormatVer").get<uint32_t>();
 		output_replayFormatVer = replayFormatVer;
+		replayLoadFormatVer = replayFormatVer;
 		if (replayFormatVer > currentReplayFormatVer)
 		{
 			std::string mismatchVersionDescription = _("The replay file format is newer than this version of Warzone 2100 can support.");
@@ -384,21 +426,76 @@ bool NETreplayLoadStart(std::string const &filename, ReplayOptionsHandler& optio
 		return onFail(parseError.c_str());
 	}
 
+	replayLoadChunk.clear();
+	replayLoadChunkPos = 0;
+
 	debug(LOG_INFO, "Started reading replay file \"%s\".", filename.c_str());
 	return true;
 }
 
-bool NETreplayLoadNetMessage(std::unique_ptr<NetMessage> &message, uint8_t &player)
+/// Reads and decompresses the next chunk of the message stream. Returns false at the end of the stream.
+static bool replayLoadNextChunk()
 {
-	if (!replayLoadHandle)
+	replayLoadChunk.clear();
+	replayLoadChunkPos = 0;
+
+	uint32_t compressedSize = 0;
+	uint32_t uncompressedSize = 0;
+	if (PHYSFS_readUBE32(replayLoadHandle, &compressedSize) == 0 || PHYSFS_readUBE32(replayLoadHandle, &uncompressedSize) == 0 || compressedSize == 0)
+	{
+		return false;  // End of stream.
+	}
+	ASSERT_OR_RETURN(false, uncompressedSize <= MaxReplayChunkSize && compressedSize <= compressBound(MaxReplayChunkSize), "Replay chunk too large (%" PRIu32 " bytes)", uncompressedSize);
+
+	std::vector<uint8_t> compressed(compressedSize);
+	if (WZ_PHYSFS_readBytes(replayLoadHandle, compressed.data(), compressedSize) != compressedSize)
 	{
+		debug(LOG_ERROR, "Truncated replay chunk");
 		return false;
 	}
 
-	WZ_PHYSFS_readBytes(replayLoadHandle, &player, 1);
+	replayLoadChunk.resize(uncompressedSize);
+	uLongf destLen = uncompressedSize;
+	if (uncompress(replayLoadChunk.data(), &destLen, compressed.data(), compressedSize) != Z_OK || destLen != uncompressedSize)
+	{
+		debug(LOG_ERROR, "Corrupt replay chunk");
+		replayLoadChunk.clear();
+		return false;
+	}
+	return true;
+}
+
+/// Reads from the message stream, which is in compressed chunks from format version 3, and raw before that.
+static size_t replayLoadReadBytes(void *buffer, size_t len)
+{
+	if (replayLoadFormatVer < FirstCompressedReplayFormatVer)
+	{
+		PHYSFS_sint64 read = WZ_PHYSFS_readBytes(replayLoadHandle, buffer, static_cast<PHYSFS_uint32>(len));
+		return read > 0 ? static_cast<size_t>(read) : 0;
+	}
+
+	uint8_t *out = static_cast<uint8_t *>(buffer);
+	size_t done = 0;
+	while (done < len)
+	{
+		if (replayLoadChunkPos == replayLoadChunk.size() && !replayLoadNextChunk())
+		{
+			break;
+		}
+		size_t n = std::min(len - done, replayLoadChunk.size() - replayLoadChunkPos);
+		memcpy(out + done, replayLoadChunk.data() + replayLoadChunkPos, n);
+		replayLoadChunkPos += n;
+		done += n;
+	}
+	return done;
+}
+
+static bool replayLoadMessage(std::unique_ptr<NetMessage> &message, uint8_t &player)
+{
+	replayLoadReadBytes(&player, 1);
 
 	uint8_t type;
-	WZ_PHYSFS_readBytes(replayLoadHandle, &type, 1);
+	replayLoadReadBytes(&type, 1);
 
 	uint32_t len = 0;
 	uint8_t b;
@@ -406,7 +503,7 @@ bool NETreplayLoadNetMessage(std::unique_ptr<NetMessage> &message, uint8_t &play
 	bool rd;
 	do
 	{
-		rd = WZ_PHYSFS_readBytes(replayLoadHandle, &b, 1);
+		rd = replayLoadReadBytes(&b, 1);
 	} while (decode_uint32_t(b, len, n++));
 
 	if (!rd)
@@ -416,7 +513,7 @@ bool NETreplayLoadNetMessage(std::unique_ptr<NetMessage> &message, uint8_t &play
 
 	message = std::make_unique<NetMessage>(type);
 	message->data.resize(len);
-	size_t messageRead = WZ_PHYSFS_readBytes(replayLoadHandle, message->data.data(), message->data.size());
+	size_t messageRead = replayLoadReadBytes(message->data.data(), message->data.size());
 	if (messageRead != message->data.size())
 	{
 		return false;
@@ -425,6 +522,16 @@ bool NETreplayLoadNetMessage(std::unique_ptr<NetMessage> &message, uint8_t &play
 	return (message->type > GAME_MIN_TYPE && message->type < GAME_MAX_TYPE) || message->type == REPLAY_ENDED;
 }
 
+bool NETreplayLoadNetMessage(std::unique_ptr<NetMessage> &message, uint8_t &player)
+{
+	if (!replayLoadHandle)
+	{
+		return false;
+	}
+
+	return replayLoadMessage(message, player);
+}
+
 bool NETreplayLoadStop()
 {
 	if (!replayLoadHandle)
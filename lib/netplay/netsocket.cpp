@@ -28,9 +28,19 @@
 #include "netsocket.h"
 
 #include <vector>
+#include <deque>
 #include <algorithm>
+#include <chrono>
 #include <map>
 
+#if defined(WZ_OS_LINUX)
+# define WZ_SOCKET_USE_EPOLL
+# include <sys/epoll.h>
+#endif
+#if defined(WZ_OS_UNIX)
+# include <sys/uio.h>
+#endif
+
 #if !defined(ZLIB_CONST)
 #  define ZLIB_CONST
 #endif
@@ -56,7 +66,7 @@ struct Socket
 	 *
 	 * All non-listening sockets will only use the first socket handle.
 	 */
-	Socket() : ready(false), writeError(false), deleteLater(false), isCompressed(false), readDisconnected(false), zDeflateInSize(0)
+	Socket() : ready(false), writeError(false), deleteLater(false), isCompressed(false), readDisconnected(false), zDeflateInSize(0), zDeflateLevel(0)
 	{
 		memset(&zDeflate, 0, sizeof(zDeflate));
 		memset(&zInflate, 0, sizeof(zInflate));
@@ -71,9 +81,11 @@ struct Socket
 
 	bool isCompressed;
 	bool readDisconnected;  ///< True iff a call to recv() returned 0.
+	bool readThrottled = false;  ///< Skipped by checkSockets, see socketSetReadThrottled().
 	z_stream zDeflate;
 	z_stream zInflate;
 	unsigned zDeflateInSize;
+	int zDeflateLevel;      ///< Current deflate level, follows socketCompressionLevel at flush boundaries.
 	bool zInflateNeedInput;
 	std::vector<uint8_t> zDeflateOutBuf;
 	std::vector<uint8_t> zInflateInBuf;
@@ -82,15 +94,168 @@ struct Socket
 struct SocketSet
 {
 	std::vector<Socket *> fds;
+#if defined(WZ_SOCKET_USE_EPOLL)
+	int epollFd = -1;                                 ///< Only used by sets from allocSocketSet(). If -1, checkSockets() falls back to select().
+	mutable std::vector<struct epoll_event> events;   ///< Output buffer for epoll_wait(), one entry per socket in the set.
+	mutable std::vector<Socket *> epollMuted;         ///< Throttled sockets, registered without EPOLLIN until they are no longer throttled.
+#endif
+};
+
+#if defined(WZ_OS_WIN)
+typedef WSABUF SocketIoVec;
+static inline void setSocketIoVec(SocketIoVec &vec, uint8_t *data, size_t len)
+{
+	vec.buf = reinterpret_cast<CHAR *>(data);
+	vec.len = static_cast<ULONG>(len);
+}
+#else
+typedef struct iovec SocketIoVec;
+static inline void setSocketIoVec(SocketIoVec &vec, uint8_t *data, size_t len)
+{
+	vec.iov_base = data;
+	vec.iov_len = len;
+}
+#endif
+
+/// Data waiting to be written to a socket by the socket thread.
+/// Stored as a queue of fixed size chunks, so appending never moves old data, and a partial send only advances an offset instead of moving the rest of the data.
+/// Must only be used while holding socketThreadMutex.
+class SocketWriteQueue
+{
+public:
+	enum { ChunkSize = 16384, MaxIoVecs = 16 };
+
+	SocketWriteQueue() : readOffset(0) {}
+	~SocketWriteQueue();
+	SocketWriteQueue(const SocketWriteQueue &) = delete;
+	void operator =(const SocketWriteQueue &) = delete;
+
+	bool empty() const
+	{
+		return chunks.empty();
+	}
+	void append(const uint8_t *data, size_t len);
+	size_t gather(SocketIoVec (&vecs)[MaxIoVecs]);  ///< Fills vecs with the start of the pending data, and returns the number of vecs used.
+	void consume(size_t len);                        ///< Drops len bytes from the start of the pending data, after they have been sent.
+
+private:
+	std::deque<std::vector<uint8_t>> chunks;  ///< Each chunk has a capacity of ChunkSize. Only the last chunk may be partly filled.
+	size_t readOffset;                        ///< Number of bytes of the first chunk that were already sent.
+
+	static std::vector<std::vector<uint8_t>> spareChunks;  ///< Chunks from emptied queues, reused instead of reallocating.
 };
 
+std::vector<std::vector<uint8_t>> SocketWriteQueue::spareChunks;
+
+SocketWriteQueue::~SocketWriteQueue()
+{
+	consume(SIZE_MAX);
+}
+
+void SocketWriteQueue::append(const uint8_t *data, size_t len)
+{
+	while (len > 0)
+	{
+		if (chunks.empty() || chunks.back().size() == ChunkSize)
+		{
+			if (!spareChunks.empty())
+			{
+				chunks.push_back(std::move(spareChunks.back()));
+				spareChunks.pop_back();
+			}
+			else
+			{
+				chunks.emplace_back();
+				chunks.back().reserve(ChunkSize);
+			}
+		}
+		std::vector<uint8_t> &chunk = chunks.back();
+		size_t n = std::min<size_t>(len, ChunkSize - chunk.size());
+		chunk.insert(chunk.end(), data, data + n);
+		data += n;
+		len -= n;
+	}
+}
+
+size_t SocketWriteQueue::gather(SocketIoVec (&vecs)[MaxIoVecs])
+{
+	size_t count = 0;
+	for (auto chunk = chunks.begin(); chunk != chunks.end() && count < MaxIoVecs; ++chunk, ++count)
+	{
+		size_t offset = count == 0 ? readOffset : 0;
+		setSocketIoVec(vecs[count], chunk->data() + offset, chunk->size() - offset);
+	}
+	return count;
+}
+
+void SocketWriteQueue::consume(size_t len)
+{
+	while (len > 0 && !chunks.empty())
+	{
+		size_t remaining = chunks.front().size() - readOffset;
+		if (len < remaining)
+		{
+			readOffset += len;
+			return;
+		}
+		len -= remaining;
+		readOffset = 0;
+		chunks.front().clear();
+		if (spareChunks.size() < 64)
+		{
+			spareChunks.push_back(std::move(chunks.front()));
+		}
+		chunks.pop_front();
+	}
+}
+
+
+// Adaptive deflate level, shared by all compressed sockets. Lowered while compressing takes up too much of the host's time, for example
+// when hosting many players and spectators, and raised again once it doesn't. Only used from the main thread (writeAll and socketFlush).
+static const int socketCompressionMaxLevel = 6;
+static const int socketCompressionMinLevel = 1;
+static const double socketCompressionBusyHigh = 0.05;  ///< Lower the level if more than this fraction of wall time is spent compressing.
+static const double socketCompressionBusyLow = 0.01;   ///< Raise the level if less than this fraction of wall time is spent compressing.
+static int socketCompressionLevel = socketCompressionMaxLevel;
+static std::chrono::steady_clock::duration socketCompressionBusyTime = std::chrono::steady_clock::duration::zero();
+static std::chrono::steady_clock::time_point socketCompressionWindowStart = std::chrono::steady_clock::now();
+
+/// Updates and returns socketCompressionLevel, based on the time spent compressing during the last second.
+static int socketCompressionUpdateLevel()
+{
+	auto now = std::chrono::steady_clock::now();
+	auto window = now - socketCompressionWindowStart;
+	if (window < std::chrono::seconds(1))
+	{
+		return socketCompressionLevel;
+	}
+
+	double busy = std::chrono::duration<double>(socketCompressionBusyTime).count() / std::chrono::duration<double>(window).count();
+	if (busy > socketCompressionBusyHigh && socketCompressionLevel > socketCompressionMinLevel)
+	{
+		socketCompressionLevel = std::max(socketCompressionLevel - 2, socketCompressionMinLevel);
+		debug(LOG_NET, "Compression took %.1f%% of the time, lowering level to %d.", busy * 100, socketCompressionLevel);
+	}
+	else if (busy < socketCompressionBusyLow && socketCompressionLevel < socketCompressionMaxLevel)
+	{
+		++socketCompressionLevel;
+		debug(LOG_NET, "Compression took %.1f%% of the time, raising level to %d.", busy * 100, socketCompressionLevel);
+	}
+	socketCompressionWindowStart = now;
+	socketCompressionBusyTime = std::chrono::steady_clock::duration::zero();
+	return socketCompressionLevel;
+}
 
 static WZ_MUTEX *socketThreadMutex;
 static WZ_SEMAPHORE *socketThreadSemaphore;
 static WZ_THREAD *socketThread = nullptr;
 static bool socketThreadQuit;
-typedef std::map<Socket *, std::vector<uint8_t>> SocketThreadWriteMap;
+typedef std::map<Socket *, SocketWriteQueue> SocketThreadWriteMap;
 static SocketThreadWriteMap socketThreadWrites;
+#if defined(WZ_SOCKET_USE_EPOLL)
+static int socketThreadEpollFd = -1;  ///< Sockets with pending writes, waiting for EPOLLOUT. If -1, the socket thread falls back to select().
+static bool socketThreadEpollFailed = false;  ///< Set when epoll_ctl fails. The socket thread then closes socketThreadEpollFd itself, as it may be waiting on it.
+#endif
 
 
 static void socketCloseNow(Socket *sock);
@@ -101,6 +266,11 @@ bool socketReadReady(Socket const *sock)
 	return sock->ready;
 }
 
+void socketSetReadThrottled(Socket *sock, bool throttled)
+{
+	sock->readThrottled = throttled;
+}
+
 int getSockErr()
 {
 #if   defined(WZ_OS_UNIX)
@@ -350,7 +520,8 @@ const char *strSockError(int error)
  */
 static bool connectionIsOpen(Socket *sock)
 {
-	const SocketSet set = {std::vector<Socket *>(1, sock)};
+	SocketSet set;  // Temporary set, which uses select() rather than epoll.
+	set.fds.push_back(sock);
 
 	ASSERT_OR_RETURN((setSockErr(EBADF), false),
 	                 sock && sock->fd[SOCK_CONNECTION] != INVALID_SOCKET, "Invalid socket");
@@ -392,101 +563,190 @@ static bool connectionIsOpen(Socket *sock)
 	return true;
 }
 
-static int socketThreadFunction(void *)
+/// Sends as many of the given buffers as the socket accepts, without blocking.
+static ssize_t socketSendGathered(Socket *sock, SocketIoVec *vecs, size_t count)
+{
+#if defined(WZ_OS_WIN)
+	DWORD sent = 0;
+	if (WSASend(sock->fd[SOCK_CONNECTION], vecs, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+	{
+		return SOCKET_ERROR;
+	}
+	return sent;
+#else
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = vecs;
+	msg.msg_iovlen = count;
+	return sendmsg(sock->fd[SOCK_CONNECTION], &msg, MSG_NOSIGNAL);
+#endif
+}
+
+/// Removes the socket from the pending writes, and deletes it if socketClose() was already called. Must hold socketThreadMutex.
+static void socketThreadEraseWrite(SocketThreadWriteMap::iterator w)
+{
+	Socket *sock = w->first;
+#if defined(WZ_SOCKET_USE_EPOLL)
+	if (socketThreadEpollFd != -1)
+	{
+		epoll_ctl(socketThreadEpollFd, EPOLL_CTL_DEL, sock->fd[SOCK_CONNECTION], nullptr);
+	}
+#endif
+	socketThreadWrites.erase(w);
+	if (sock->deleteLater)
+	{
+		socketCloseNow(sock);
+	}
+}
+
+/// Appends data to the pending writes of the socket, and wakes up the socket thread if needed.
+static void socketThreadQueueWrite(Socket *sock, const uint8_t *data, size_t size)
 {
 	wzMutexLock(socketThreadMutex);
-	while (!socketThreadQuit)
+	if (socketThreadWrites.empty())
 	{
-#if   defined(WZ_OS_UNIX)
-		SOCKET maxfd = INT_MIN;
-#elif defined(WZ_OS_WIN)
-		SOCKET maxfd = 0;
+		wzSemaphorePost(socketThreadSemaphore);
+	}
+	SocketWriteQueue &writeQueue = socketThreadWrites[sock];
+#if defined(WZ_SOCKET_USE_EPOLL)
+	if (writeQueue.empty() && socketThreadEpollFd != -1 && !socketThreadEpollFailed)
+	{
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLOUT;
+		event.data.ptr = sock;
+		if (epoll_ctl(socketThreadEpollFd, EPOLL_CTL_ADD, sock->fd[SOCK_CONNECTION], &event) == SOCKET_ERROR && errno != EEXIST)
+		{
+			debug(LOG_ERROR, "epoll_ctl failed, falling back to select: %s", strSockError(getSockErr()));
+			socketThreadEpollFailed = true;
+		}
+	}
 #endif
-		fd_set fds;
-		FD_ZERO(&fds);
-		for (auto& socketThreadWrite : socketThreadWrites)
+	writeQueue.append(data, size);
+	wzMutexUnlock(socketThreadMutex);
+}
+
+/// Writes as much pending data as the socket accepts. Must hold socketThreadMutex.
+static void socketThreadWrite(SocketThreadWriteMap::iterator w)
+{
+	Socket *sock = w->first;
+	SocketWriteQueue &writeQueue = w->second;
+	ASSERT(!writeQueue.empty(), "writeQueue[sock] must not be empty.");
+
+	// Write data.
+	// FIXME SOMEHOW AAARGH This send() call can't block, but unless the socket is not set to blocking (setting the socket to nonblocking had better work, or else), does anyway (at least sometimes, when someone quits). Not reproducible except in public releases.
+	SocketIoVec vecs[SocketWriteQueue::MaxIoVecs];
+	size_t numVecs = writeQueue.gather(vecs);
+	ssize_t retSent = socketSendGathered(sock, vecs, numVecs);
+	if (retSent != SOCKET_ERROR)
+	{
+		// Drop as much data as written.
+		writeQueue.consume(retSent);
+		if (writeQueue.empty())
 		{
-			if (!socketThreadWrite.second.empty())
-			{
-				SOCKET fd = socketThreadWrite.first->fd[SOCK_CONNECTION];
-				maxfd = std::max(maxfd, fd);
-				ASSERT(!FD_ISSET(fd, &fds), "Duplicate file descriptor!");  // Shouldn't be possible, but blocking in send, after select says it won't block, shouldn't be possible either.
-				FD_SET(fd, &fds);
-			}
+			socketThreadEraseWrite(w);  // Nothing left to write, delete from pending list.
 		}
-		struct timeval tv = {0, 50 * 1000};
+		return;
+	}
 
-		// Check if we can write to any sockets.
-		wzMutexUnlock(socketThreadMutex);
-		int ret = select(maxfd + 1, nullptr, &fds, nullptr, &tv);
-		wzMutexLock(socketThreadMutex);
+	switch (getSockErr())
+	{
+	case EAGAIN:
+#if defined(EWOULDBLOCK) && EAGAIN != EWOULDBLOCK
+	case EWOULDBLOCK:
+#endif
+		if (!connectionIsOpen(sock))
+		{
+			debug(LOG_NET, "Socket error");
+			sock->writeError = true;
+			socketThreadEraseWrite(w);  // Socket broken, don't try writing to it again.
+			break;
+		}
+	case EINTR:
+		break;
+#if defined(EPIPE)
+	case EPIPE:
+#endif
+	default:
+		sock->writeError = true;
+		socketThreadEraseWrite(w);  // Socket broken, don't try writing to it again.
+		break;
+	}
+}
 
-		// We can write to some sockets. (Ignore errors from select, we may have deleted the socket after unlocking the mutex, and before calling select.)
-		if (ret > 0)
+static int socketThreadFunction(void *)
+{
+	wzMutexLock(socketThreadMutex);
+	while (!socketThreadQuit)
+	{
+#if defined(WZ_SOCKET_USE_EPOLL)
+		if (socketThreadEpollFailed && socketThreadEpollFd != -1)
 		{
-			for (auto i = socketThreadWrites.begin(); i != socketThreadWrites.end();)
-			{
-				auto w = i;
-				++i;
+			// Nobody else waits on the fd, so it's safe to close it here. Pending writes are picked up by select() from now on.
+			close(socketThreadEpollFd);
+			socketThreadEpollFd = -1;
+		}
+		if (socketThreadEpollFd != -1)
+		{
+			struct epoll_event events[64];
+			int epollFd = socketThreadEpollFd;
 
-				Socket *sock = w->first;
-				std::vector<uint8_t> &writeQueue = w->second;
-				ASSERT(!writeQueue.empty(), "writeQueue[sock] must not be empty.");
+			// Check if we can write to any sockets.
+			wzMutexUnlock(socketThreadMutex);
+			int ret = epoll_wait(epollFd, events, ARRAY_SIZE(events), 50);
+			wzMutexLock(socketThreadMutex);
 
-				if (!FD_ISSET(sock->fd[SOCK_CONNECTION], &fds))
+			// Sockets may have been written and deleted after unlocking the mutex, so only trust sockets which still have pending writes.
+			for (int n = 0; n < ret; ++n)
+			{
+				auto w = socketThreadWrites.find(static_cast<Socket *>(events[n].data.ptr));
+				if (w != socketThreadWrites.end())
 				{
-					continue;  // This socket is not ready for writing, or we don't have anything to write.
+					socketThreadWrite(w);
 				}
-
-				// Write data.
-				// FIXME SOMEHOW AAARGH This send() call can't block, but unless the socket is not set to blocking (setting the socket to nonblocking had better work, or else), does anyway (at least sometimes, when someone quits). Not reproducible except in public releases.
-				ssize_t retSent = send(sock->fd[SOCK_CONNECTION], reinterpret_cast<char *>(&writeQueue[0]), writeQueue.size(), MSG_NOSIGNAL);
-				if (retSent != SOCKET_ERROR)
+			}
+		}
+		else
+#endif
+		{
+#if   defined(WZ_OS_UNIX)
+			SOCKET maxfd = INT_MIN;
+#elif defined(WZ_OS_WIN)
+			SOCKET maxfd = 0;
+#endif
+			fd_set fds;
+			FD_ZERO(&fds);
+			for (auto& socketThreadWrite : socketThreadWrites)
+			{
+				if (!socketThreadWrite.second.empty())
 				{
-					// Erase as much data as written.
-					writeQueue.erase(writeQueue.begin(), writeQueue.begin() + retSent);
-					if (writeQueue.empty())
-					{
-						socketThreadWrites.erase(w);  // Nothing left to write, delete from pending list.
-						if (sock->deleteLater)
-						{
-							socketCloseNow(sock);
-						}
-					}
+					SOCKET fd = socketThreadWrite.first->fd[SOCK_CONNECTION];
+					maxfd = std::max(maxfd, fd);
+					ASSERT(!FD_ISSET(fd, &fds), "Duplicate file descriptor!");  // Shouldn't be possible, but blocking in send, after select says it won't block, shouldn't be possible either.
+					FD_SET(fd, &fds);
 				}
-				else
+			}
+			struct timeval tv = {0, 50 * 1000};
+
+			// Check if we can write to any sockets.
+			wzMutexUnlock(socketThreadMutex);
+			int ret = select(maxfd + 1, nullptr, &fds, nullptr, &tv);
+			wzMutexLock(socketThreadMutex);
+
+			// We can write to some sockets. (Ignore errors from select, we may have deleted the socket after unlocking the mutex, and before calling select.)
+			if (ret > 0)
+			{
+				for (auto i = socketThreadWrites.begin(); i != socketThreadWrites.end();)
 				{
-					switch (getSockErr())
+					auto w = i;
+					++i;
+
+					if (!FD_ISSET(w->first->fd[SOCK_CONNECTION], &fds))
 					{
-					case EAGAIN:
-#if defined(EWOULDBLOCK) && EAGAIN != EWOULDBLOCK
-					case EWOULDBLOCK:
-#endif
-						if (!connectionIsOpen(sock))
-						{
-							debug(LOG_NET, "Socket error");
-							sock->writeError = true;
-							socketThreadWrites.erase(w);  // Socket broken, don't try writing to it again.
-							if (sock->deleteLater)
-							{
-								socketCloseNow(sock);
-							}
-							break;
-						}
-					case EINTR:
-						break;
-#if defined(EPIPE)
-					case EPIPE:
-#endif
-					default:
-						sock->writeError = true;
-						socketThreadWrites.erase(w);  // Socket broken, don't try writing to it again.
-						if (sock->deleteLater)
-						{
-							socketCloseNow(sock);
-						}
-						break;
+						continue;  // This socket is not ready for writing, or we don't have anything to write.
 					}
+
+					socketThreadWrite(w);
 				}
 			}
 		}
@@ -631,14 +891,7 @@ ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCoun
 	{
 		if (!sock->isCompressed)
 		{
-			wzMutexLock(socketThreadMutex);
-			if (socketThreadWrites.empty())
-			{
-				wzSemaphorePost(socketThreadSemaphore);
-			}
-			std::vector<uint8_t> &writeQueue = socketThreadWrites[sock];
-			writeQueue.insert(writeQueue.end(), static_cast<char const *>(buf), static_cast<char const *>(buf) + size);
-			wzMutexUnlock(socketThreadMutex);
+			socketThreadQueueWrite(sock, static_cast<uint8_t const *>(buf), size);
 			rawBytes = size;
 		}
 		else
@@ -668,6 +921,7 @@ ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCoun
 			sock->zDeflate.next_in = (const Bytef *)buf;
 		#endif
 
+			auto compressStart = std::chrono::steady_clock::now();
 			sock->zDeflate.avail_in = size;
 			sock->zDeflateInSize += sock->zDeflate.avail_in;
 			do
@@ -686,6 +940,7 @@ ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCoun
 			while (sock->zDeflate.avail_out == 0);
 
 			ASSERT(sock->zDeflate.avail_in == 0, "zlib didn't compress everything!");
+			socketCompressionBusyTime += std::chrono::steady_clock::now() - compressStart;
 		}
 	}
 
@@ -705,6 +960,8 @@ void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount)
 
 	ASSERT(!sock->writeError, "Socket write error?? (Player: %" PRIu8 "", player);
 
+	auto compressStart = std::chrono::steady_clock::now();
+
 	// Flush data out of zlib compression state.
 	do
 	{
@@ -723,19 +980,31 @@ void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount)
 	}
 	while (sock->zDeflate.avail_out == 0);
 
-	if (sock->zDeflateOutBuf.empty())
+	// Switch level at a flush boundary, where the stream has no pending input.
+	int wantedLevel = socketCompressionUpdateLevel();
+	if (wantedLevel != sock->zDeflateLevel)
 	{
-		return;  // No data to flush out.
+		size_t alreadyHave = sock->zDeflateOutBuf.size();
+		sock->zDeflateOutBuf.resize(alreadyHave + 1000);  // deflateParams may need to end the current block.
+		sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
+		sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
+
+		if (deflateParams(&sock->zDeflate, wantedLevel, Z_DEFAULT_STRATEGY) == Z_OK)
+		{
+			sock->zDeflateLevel = wantedLevel;
+		}
+
+		sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
 	}
 
-	wzMutexLock(socketThreadMutex);
-	if (socketThreadWrites.empty())
+	socketCompressionBusyTime += std::chrono::steady_clock::now() - compressStart;
+
+	if (sock->zDeflateOutBuf.empty())
 	{
-		wzSemaphorePost(socketThreadSemaphore);
+		return;  // No data to flush out.
 	}
-	std::vector<uint8_t> &writeQueue = socketThreadWrites[sock];
-	writeQueue.insert(writeQueue.end(), sock->zDeflateOutBuf.begin(), sock->zDeflateOutBuf.end());
-	wzMutexUnlock(socketThreadMutex);
+
+	socketThreadQueueWrite(sock, sock->zDeflateOutBuf.data(), sock->zDeflateOutBuf.size());
 
 	// Primitive network logging, uncomment to use.
 	//printf("Size %3u ->%3zu, buf =", sock->zDeflateInSize, sock->zDeflateOutBuf.size());
@@ -748,12 +1017,13 @@ void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount)
 	sock->zDeflateOutBuf.clear();
 }
 
-void socketBeginCompression(Socket *sock)
+void socketBeginCompression(Socket *sock, SocketCompression method)
 {
-	if (sock->isCompressed)
+	if (sock->isCompressed || method == SOCKET_COMPRESSION_NONE)
 	{
 		return;  // Nothing to do.
 	}
+	ASSERT_OR_RETURN(, method == SOCKET_COMPRESSION_ZLIB, "Unknown compression method %u", (unsigned)method);
 
 	wzMutexLock(socketThreadMutex);
 
@@ -761,7 +1031,8 @@ void socketBeginCompression(Socket *sock)
 	sock->zDeflate.zalloc = Z_NULL;
 	sock->zDeflate.zfree = Z_NULL;
 	sock->zDeflate.opaque = Z_NULL;
-	int ret = deflateInit(&sock->zDeflate, 6);
+	sock->zDeflateLevel = socketCompressionLevel;
+	int ret = deflateInit(&sock->zDeflate, sock->zDeflateLevel);
 	ASSERT(ret == Z_OK, "deflateInit failed! Sockets won't work.");
 
 	sock->zInflate.zalloc = Z_NULL;
@@ -789,11 +1060,25 @@ Socket::~Socket()
 
 SocketSet *allocSocketSet()
 {
-	return new SocketSet;
+	SocketSet *set = new SocketSet;
+#if defined(WZ_SOCKET_USE_EPOLL)
+	set->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (set->epollFd == -1)
+	{
+		debug(LOG_NET, "epoll_create1 failed, falling back to select: %s", strSockError(getSockErr()));
+	}
+#endif
+	return set;
 }
 
 void deleteSocketSet(SocketSet *set)
 {
+#if defined(WZ_SOCKET_USE_EPOLL)
+	if (set != nullptr && set->epollFd != -1)
+	{
+		close(set->epollFd);
+	}
+#endif
 	delete set;
 }
 
@@ -816,6 +1101,23 @@ void SocketSet_AddSocket(SocketSet *set, Socket *socket)
 
 	set->fds.push_back(socket);
 	debug(LOG_NET, "Socket added: set->fds[%lu] = %p", (unsigned long)i, static_cast<void *>(socket));
+
+#if defined(WZ_SOCKET_USE_EPOLL)
+	if (set->epollFd != -1)
+	{
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = socket;
+		if (epoll_ctl(set->epollFd, EPOLL_CTL_ADD, socket->fd[SOCK_CONNECTION], &event) == SOCKET_ERROR && errno != EEXIST)
+		{
+			debug(LOG_ERROR, "epoll_ctl failed, falling back to select: %s", strSockError(getSockErr()));
+			close(set->epollFd);
+			set->epollFd = -1;
+		}
+		set->events.resize(set->fds.size());
+	}
+#endif
 }
 
 /**
@@ -828,6 +1130,14 @@ void SocketSet_DelSocket(SocketSet *set, Socket *socket)
 	{
 		debug(LOG_NET, "Socket %p erased (set->fds[%lu])", static_cast<void *>(socket), (unsigned long)i);
 		set->fds.erase(set->fds.begin() + i);
+
+#if defined(WZ_SOCKET_USE_EPOLL)
+		set->epollMuted.erase(std::remove(set->epollMuted.begin(), set->epollMuted.end(), socket), set->epollMuted.end());
+		if (set->epollFd != -1 && socket->fd[SOCK_CONNECTION] != INVALID_SOCKET)
+		{
+			epoll_ctl(set->epollFd, EPOLL_CTL_DEL, socket->fd[SOCK_CONNECTION], nullptr);
+		}
+#endif
 	}
 }
 
@@ -924,6 +1234,74 @@ static void socketBlockSIGPIPE(const SOCKET fd, bool block_sigpipe)
 #endif
 }
 
+#if defined(WZ_SOCKET_USE_EPOLL)
+/// epoll is level-triggered, so a throttled socket with unread data would end every wait at once. Stop asking for
+/// EPOLLIN on sockets while they are throttled, and ask again once they no longer are.
+static void updateEpollThrottling(const SocketSet *set)
+{
+	for (auto sock : set->fds)
+	{
+		bool muted = std::find(set->epollMuted.begin(), set->epollMuted.end(), sock) != set->epollMuted.end();
+		if (sock->readThrottled == muted)
+		{
+			continue;
+		}
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = sock->readThrottled ? 0 : EPOLLIN;
+		event.data.ptr = sock;
+		if (epoll_ctl(set->epollFd, EPOLL_CTL_MOD, sock->fd[SOCK_CONNECTION], &event) == SOCKET_ERROR)
+		{
+			debug(LOG_NET, "epoll_ctl failed: %s", strSockError(getSockErr()));
+			continue;  // Leave it as it was, checkSocketsEpoll() ignores throttled sockets anyway.
+		}
+		if (sock->readThrottled)
+		{
+			set->epollMuted.push_back(sock);
+		}
+		else
+		{
+			set->epollMuted.erase(std::remove(set->epollMuted.begin(), set->epollMuted.end(), sock), set->epollMuted.end());
+		}
+	}
+}
+
+static int checkSocketsEpoll(const SocketSet *set, unsigned int timeout)
+{
+	updateEpollThrottling(set);
+
+	int ret;
+	do
+	{
+		ret = epoll_wait(set->epollFd, set->events.data(), static_cast<int>(set->events.size()), static_cast<int>(timeout));
+	}
+	while (ret == SOCKET_ERROR && getSockErr() == EINTR);
+
+	if (ret == SOCKET_ERROR)
+	{
+		debug(LOG_ERROR, "epoll_wait failed: %s", strSockError(getSockErr()));
+		return SOCKET_ERROR;
+	}
+
+	for (auto fd : set->fds)
+	{
+		fd->ready = false;
+	}
+	int readyCount = 0;
+	for (int n = 0; n < ret; ++n)
+	{
+		Socket *sock = static_cast<Socket *>(set->events[n].data.ptr);
+		if (!sock->readThrottled)
+		{
+			sock->ready = true;
+			++readyCount;
+		}
+	}
+
+	return readyCount;
+}
+#endif
+
 int checkSockets(const SocketSet *set, unsigned int timeout)
 {
 	if (set->fds.empty())
@@ -938,10 +1316,17 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 #endif
 
 	bool compressedReady = false;
+	bool anyPolled = false;
 	for (auto fd : set->fds)
 	{
 		ASSERT(fd->fd[SOCK_CONNECTION] != INVALID_SOCKET, "Invalid file descriptor!");
 
+		if (fd->readThrottled)
+		{
+			continue;  // Its pending data, even if already inflated, waits until it is no longer throttled.
+		}
+		anyPolled = true;
+
 		if (fd->isCompressed && !fd->zInflateNeedInput)
 		{
 			compressedReady = true;
@@ -958,12 +1343,28 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 		int ret = 0;
 		for (auto fd : set->fds)
 		{
-			fd->ready = fd->isCompressed && !fd->zInflateNeedInput;
-			++ret;
+			fd->ready = !fd->readThrottled && fd->isCompressed && !fd->zInflateNeedInput;
+			ret += fd->ready;
 		}
 		return ret;
 	}
 
+	if (!anyPolled)
+	{
+		for (auto fd : set->fds)
+		{
+			fd->ready = false;
+		}
+		return 0;
+	}
+
+#if defined(WZ_SOCKET_USE_EPOLL)
+	if (set->epollFd != -1)
+	{
+		return checkSocketsEpoll(set, timeout);
+	}
+#endif
+
 	int ret;
 	fd_set fds;
 	do
@@ -975,7 +1376,10 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 		{
 			const SOCKET fd = i->fd[SOCK_CONNECTION];
 
-			FD_SET(fd, &fds);
+			if (!i->readThrottled)
+			{
+				FD_SET(fd, &fds);
+			}
 		}
 
 		ret = select(maxfd + 1, &fds, nullptr, nullptr, &tv);
@@ -1014,7 +1418,8 @@ ssize_t readAll(Socket *sock, void *buf, size_t size, unsigned int timeout)
 {
 	ASSERT(!sock->isCompressed, "readAll on compressed sockets not implemented.");
 
-	const SocketSet set = {std::vector<Socket *>(1, sock)};
+	SocketSet set;  // Temporary set, which uses select() rather than epoll.
+	set.fds.push_back(sock);
 
 	size_t received = 0;
 
@@ -1699,6 +2104,14 @@ void SOCKETinit()
 		socketThreadQuit = false;
 		socketThreadMutex = wzMutexCreate();
 		socketThreadSemaphore = wzSemaphoreCreate(0);
+#if defined(WZ_SOCKET_USE_EPOLL)
+		socketThreadEpollFailed = false;
+		socketThreadEpollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (socketThreadEpollFd == -1)
+		{
+			debug(LOG_NET, "epoll_create1 failed, socket thread falling back to select: %s", strSockError(getSockErr()));
+		}
+#endif
 		socketThread = wzThreadCreate(socketThreadFunction, nullptr);
 		wzThreadStart(socketThread);
 	}
@@ -1714,6 +2127,13 @@ void SOCKETshutdown()
 		wzMutexUnlock(socketThreadMutex);
 		wzSemaphorePost(socketThreadSemaphore);  // Wake up the thread, so it can quit.
 		wzThreadJoin(socketThread);
+#if defined(WZ_SOCKET_USE_EPOLL)
+		if (socketThreadEpollFd != -1)
+		{
+			close(socketThreadEpollFd);
+			socketThreadEpollFd = -1;
+		}
+#endif
 		wzMutexDestroy(socketThreadMutex);
 		wzSemaphoreDestroy(socketThreadSemaphore);
 		socketThread = nullptr;
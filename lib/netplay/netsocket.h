@@ -111,6 +111,7 @@ std::vector<unsigned char> ipv6_AddressString_To_NetBinary(const std::string& ip
 std::string ipv4_NetBinary_To_AddressString(const std::vector<unsigned char>& ip4NetBinaryForm);
 std::string ipv6_NetBinary_To_AddressString(const std::vector<unsigned char>& ip6NetBinaryForm);
 WZ_DECL_NONNULL(1) bool socketReadReady(Socket const *sock);            ///< Returns if checkSockets found data to read from this Socket.
+WZ_DECL_NONNULL(1) void socketSetReadThrottled(Socket *sock, bool throttled);  ///< While throttled, checkSockets ignores this Socket and never reports it ready.
 WZ_DECL_NONNULL(1, 2)
 ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount = nullptr);  ///< Reads up to max_size bytes from the Socket. Raw count of bytes (after compression) returned in rawByteCount.
 WZ_DECL_NONNULL(1, 2)
@@ -119,7 +120,14 @@ WZ_DECL_NONNULL(1, 2)
 ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount = nullptr);  ///< Nonblocking write of size bytes to the Socket. All bytes will be written asynchronously, by a separate thread. Raw count of bytes (after compression) returned in rawByteCount, which will often be 0 until the socket is flushed.
 
 // Sockets, compressed.
-WZ_DECL_NONNULL(1) void socketBeginCompression(Socket *sock); ///< Makes future data sent compressed, and future data received expected to be compressed.
+/// Stream compression used on a connection. Chosen by the host when a client joins, and sent to the client right after the version check.
+enum SocketCompression : uint8_t
+{
+	SOCKET_COMPRESSION_NONE = 0,
+	SOCKET_COMPRESSION_ZLIB = 1,
+	SOCKET_COMPRESSION_COUNT
+};
+WZ_DECL_NONNULL(1) void socketBeginCompression(Socket *sock, SocketCompression method = SOCKET_COMPRESSION_ZLIB); ///< Makes future data sent compressed, and future data received expected to be compressed. Does nothing for SOCKET_COMPRESSION_NONE.
 WZ_DECL_NONNULL(1) bool socketReadDisconnected(Socket *sock);  ///< If readNoInt returned 0, returns true if this is the result of a disconnect, or false if the input compressed data just hasn't produced any output bytes.
 WZ_DECL_NONNULL(1) void socketFlush(Socket *sock, uint8_t player, size_t *rawByteCount = nullptr); ///< Actually sends the data written with writeAll. Only useful on compressed sockets. Note that flushing too often makes compression less effective. Raw count of bytes (after compression) returned in rawByteCount.
 
@@ -41,6 +41,7 @@
 #include "netqueue.h"
 #include "netlog.h"
 #include "src/order.h"
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -91,8 +92,7 @@ template<class Q>
 static void queue(const Q &q, uint16_t &v)
 {
 	uint8_t b[2] = {uint8_t(v >> 8), uint8_t(v)};
-	queue(q, b[0]);
-	queue(q, b[1]);
+	q.bytes(b, 2);
 	if (Q::Direction == Q::Read)
 	{
 		v = b[0] << 8 | b[1];
@@ -102,26 +102,29 @@ static void queue(const Q &q, uint16_t &v)
 template<class Q>
 static void queue(const Q &q, uint32_t &vOrig)
 {
-	if (Q::Direction == Q::Write)
+	if constexpr (Q::Direction == Q::Write)
 	{
-		uint32_t v = vOrig;
-		bool moreBytes = true;
-		for (int n = 0; moreBytes; ++n)
-		{
-			uint8_t b;
-			moreBytes = encode_uint32_t(b, v, n);
-			queue(q, b);
-		}
+		uint8_t b[5];
+		q.bytes(b, encode_uint32_t(b, vOrig));
 	}
-	else if (Q::Direction == Q::Read)
+	else
 	{
+		size_t available;
+		const uint8_t *b = q.peekBytes(available);
+		if (available >= 5)
+		{
+			// Whole value is certainly in the message, so decode without checking each byte.
+			q.skipBytes(decode_uint32_t(b, vOrig));
+			return;
+		}
+
 		uint32_t v = 0;
 		bool moreBytes = true;
 		for (int n = 0; moreBytes; ++n)
 		{
-			uint8_t b = 0;
-			queue(q, b);
-			moreBytes = decode_uint32_t(b, v, n);
+			uint8_t byte = 0;
+			queue(q, byte);
+			moreBytes = decode_uint32_t(byte, v, n);
 		}
 
 		vOrig = v;
@@ -268,6 +271,27 @@ static void queue(const Q &q, std::vector<T> &v)
 	}
 }
 
+template<class Q>
+static void queue(const Q &q, std::vector<uint8_t> &v)
+{
+	ASSERT(v.size() <= static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "v.size() exceeds uint32_t max");
+	uint32_t len = static_cast<uint32_t>(std::min(v.size(), static_cast<size_t>(std::numeric_limits<uint32_t>::max())));
+	queue(q, len);
+	if constexpr (Q::Direction == Q::Read)
+	{
+		// Don't trust len further than the data actually in the message.
+		size_t available;
+		q.peekBytes(available);
+		v.resize(std::min<size_t>(len, available));
+		q.bytes(v.data(), v.size());
+		q.skipBytes(len - v.size());
+	}
+	else
+	{
+		q.bytes(v.data(), len);
+	}
+}
+
 template<class Q>
 static void queue(const Q &q, NetMessage &v)
 {
@@ -288,6 +312,19 @@ static void queueAuto(T &v)
 	}
 }
 
+/// Bulk version of queueAuto() for byte arrays, which bounds checks once instead of per byte.
+static void queueAutoBytes(uint8_t *v, size_t len)
+{
+	if (NETgetPacketDir() == PACKET_ENCODE)
+	{
+		writer.bytes(v, len);
+	}
+	else if (NETgetPacketDir() == PACKET_DECODE)
+	{
+		reader.bytes(v, len);
+	}
+}
+
 // Queue selection functions
 
 /// Gets the &NetQueuePair::send or NetQueue *, corresponding to queue.
@@ -503,7 +540,8 @@ void NETbeginEncode(NETQUEUE queue, uint8_t type)
 	NETsetPacketDir(PACKET_ENCODE);
 
 	queueInfo = queue;
-	message = type;
+	message.type = type;
+	message.data.clear();  // Keeps the capacity, so encoding does not reallocate once warmed up.
 	writer = MessageWriter(message);
 }
 
@@ -724,10 +762,7 @@ void NETstring(char *str, uint16_t maxlen)
 		len = maxlen - 1;
 	}
 
-	for (unsigned i = 0; i < len; ++i)
-	{
-		queueAuto(str[i]);
-	}
+	queueAutoBytes(reinterpret_cast<uint8_t *>(str), len);
 
 	if (NETgetPacketDir() == PACKET_DECODE)
 	{
@@ -806,18 +841,100 @@ void NETbytes(std::vector<uint8_t> *vec, unsigned maxLen)
 		vec->resize(len);  // vec->assign(len, 0) would call the wrong version of assign, here.
 	}
 
-	for (unsigned i = 0; i < len; ++i)
+	queueAutoBytes(vec->data(), len);
+}
+
+void NETuint32_tSet(std::vector<uint32_t> *ids, uint32_t maxCount)
+{
+	/*
+	 * Sent as the number of runs, then for each run of consecutive ids, the
+	 * distance from the end of the previous run (or from 0) to its first id,
+	 * and the number of ids in the run minus one. A box-selection of n droids
+	 * built one after the other is then only a few bytes, rather than n ids.
+	 */
+
+	uint32_t numRuns = 0;
+	if (NETgetPacketDir() == PACKET_ENCODE)
 	{
-		queueAuto((*vec)[i]);
+		std::sort(ids->begin(), ids->end());
+		ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+		ASSERT(ids->size() <= maxCount, "%zu ids, expected at most %" PRIu32 "", ids->size(), maxCount);
+
+		for (size_t i = 0; i < ids->size(); ++i)
+		{
+			numRuns += i == 0 || (*ids)[i] != (*ids)[i - 1] + 1;
+		}
+		queueAuto(numRuns);
+
+		uint32_t prev = 0;
+		for (size_t i = 0; i < ids->size();)
+		{
+			size_t end = i + 1;
+			while (end < ids->size() && (*ids)[end] == (*ids)[end - 1] + 1)
+			{
+				++end;
+			}
+			uint32_t gap = (*ids)[i] - prev;
+			uint32_t extra = static_cast<uint32_t>(end - i - 1);
+			queueAuto(gap);
+			queueAuto(extra);
+			prev = (*ids)[end - 1];
+			i = end;
+		}
+	}
+	else if (NETgetPacketDir() == PACKET_DECODE)
+	{
+		queueAuto(numRuns);
+		ids->clear();
+
+		uint32_t prev = 0;
+		for (uint32_t run = 0; run < numRuns; ++run)
+		{
+			uint32_t gap = 0, extra = 0;
+			queueAuto(gap);
+			queueAuto(extra);
+			// Runs after the first must leave at least one id out, else they would overlap or continue the previous run.
+			if ((run > 0 && gap < 2) || extra >= maxCount - std::min<size_t>(ids->size(), maxCount) || gap > UINT32_MAX - prev || extra > UINT32_MAX - (prev + gap))
+			{
+				debug(LOG_ERROR, "NETuint32_tSet: Bad run (gap %" PRIu32 ", length %" PRIu32 ") after %zu ids", gap, extra + 1, ids->size());
+				ids->clear();
+				return;
+			}
+			uint32_t first = prev + gap;
+			for (uint32_t id = first; id != first + extra + 1; ++id)
+			{
+				ids->push_back(id);
+			}
+			prev = first + extra;
+		}
 	}
 }
 
 void NETbin(uint8_t *str, uint32_t len)
 {
-	for (unsigned i = 0; i < len; ++i)
-	{
-		queueAuto(str[i]);
-	}
+	queueAutoBytes(str, len);
+}
+
+uint8_t *NETreserveEncodeBytes(size_t len)
+{
+	ASSERT(NETgetPacketDir() == PACKET_ENCODE, "Not encoding!");
+	return writer.reserveBytes(len);
+}
+
+void NETunreserveEncodeBytes(size_t len)
+{
+	writer.unreserveBytes(len);
+}
+
+const uint8_t *NETpeekDecodeBytes(size_t &available)
+{
+	ASSERT(NETgetPacketDir() == PACKET_DECODE, "Not decoding!");
+	return reader.peekBytes(available);
+}
+
+void NETskipDecodeBytes(size_t len)
+{
+	reader.skipBytes(len);
 }
 
 void NETPosition(Position *vp)
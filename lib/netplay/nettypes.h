@@ -100,6 +100,7 @@ void NETstring(char *str, uint16_t maxlen);
 void NETstring(char const *str, uint16_t maxlen);  ///< Encode-only version of NETstring.
 void NETbin(uint8_t *str, uint32_t len);
 void NETbytes(std::vector<uint8_t> *vec, unsigned maxLen = 10000);
+void NETuint32_tSet(std::vector<uint32_t> *ids, uint32_t maxCount = 10000);  ///< A set of ids (e.g. droids sharing one order), as delta-coded runs of consecutive ids. Sorts and deduplicates ids when encoding. Decodes to an empty set if the runs are malformed.
 
 PACKETDIR NETgetPacketDir();
 
@@ -199,6 +200,193 @@ static inline void NETauto(T (&ar)[N])
 	}
 }
 
+uint8_t *NETreserveEncodeBytes(size_t len);            ///< Appends len bytes to the message being encoded, and returns a pointer to them. Used by NETfields().
+void NETunreserveEncodeBytes(size_t len);              ///< Removes the last len bytes, which were reserved by NETreserveEncodeBytes() but not used.
+const uint8_t *NETpeekDecodeBytes(size_t &available);  ///< Returns a pointer to the unread data of the message being decoded, and sets available to its length. Used by NETfields().
+void NETskipDecodeBytes(size_t len);                   ///< Marks len bytes of the message being decoded as read.
+
+/// NETfieldCodec<T> encodes and decodes a T with the same wire format as NETauto(T &), without any bounds checks.
+/// MaxLen is the most bytes the encoded value can take, so that NETfields() can check the bounds once per message.
+template <typename T> struct NETfieldCodec;
+
+template <> struct NETfieldCodec<uint8_t>
+{
+	enum { MaxLen = 1 };
+	static uint8_t *encode(uint8_t *out, uint8_t v)
+	{
+		*out = v;
+		return out + 1;
+	}
+	static const uint8_t *decode(const uint8_t *in, uint8_t &v)
+	{
+		v = *in;
+		return in + 1;
+	}
+};
+template <> struct NETfieldCodec<int8_t>
+{
+	enum { MaxLen = 1 };
+	static uint8_t *encode(uint8_t *out, int8_t v)
+	{
+		*out = v;
+		return out + 1;
+	}
+	static const uint8_t *decode(const uint8_t *in, int8_t &v)
+	{
+		v = *in;
+		return in + 1;
+	}
+};
+template <> struct NETfieldCodec<char>
+{
+	enum { MaxLen = 1 };
+	static uint8_t *encode(uint8_t *out, char v)
+	{
+		*out = v;
+		return out + 1;
+	}
+	static const uint8_t *decode(const uint8_t *in, char &v)
+	{
+		v = *in;
+		return in + 1;
+	}
+};
+template <> struct NETfieldCodec<bool>
+{
+	enum { MaxLen = 1 };
+	static uint8_t *encode(uint8_t *out, bool v)
+	{
+		*out = v;
+		return out + 1;
+	}
+	static const uint8_t *decode(const uint8_t *in, bool &v)
+	{
+		v = *in != 0;
+		return in + 1;
+	}
+};
+template <> struct NETfieldCodec<uint16_t>
+{
+	enum { MaxLen = 2 };
+	static uint8_t *encode(uint8_t *out, uint16_t v)
+	{
+		out[0] = uint8_t(v >> 8);
+		out[1] = uint8_t(v);
+		return out + 2;
+	}
+	static const uint8_t *decode(const uint8_t *in, uint16_t &v)
+	{
+		v = in[0] << 8 | in[1];
+		return in + 2;
+	}
+};
+template <> struct NETfieldCodec<int16_t>
+{
+	enum { MaxLen = 2 };
+	static uint8_t *encode(uint8_t *out, int16_t v)
+	{
+		return NETfieldCodec<uint16_t>::encode(out, v);
+	}
+	static const uint8_t *decode(const uint8_t *in, int16_t &v)
+	{
+		uint16_t b;
+		in = NETfieldCodec<uint16_t>::decode(in, b);
+		v = b;
+		return in;
+	}
+};
+template <> struct NETfieldCodec<uint32_t>
+{
+	enum { MaxLen = 5 };
+	static uint8_t *encode(uint8_t *out, uint32_t v)
+	{
+		return out + encode_uint32_t(out, v);
+	}
+	static const uint8_t *decode(const uint8_t *in, uint32_t &v)
+	{
+		return in + decode_uint32_t(in, v);
+	}
+};
+template <> struct NETfieldCodec<int32_t>
+{
+	enum { MaxLen = 5 };
+	static uint8_t *encode(uint8_t *out, int32_t v)
+	{
+		// Same zigzag encoding as NETint32_t().
+		return NETfieldCodec<uint32_t>::encode(out, (uint32_t)v << 1 ^ (0 - ((uint32_t)v >> 31)));
+	}
+	static const uint8_t *decode(const uint8_t *in, int32_t &v)
+	{
+		uint32_t b;
+		in = NETfieldCodec<uint32_t>::decode(in, b);
+		v = b >> 1 ^ (0 - (b & 1));
+		return in;
+	}
+};
+template <> struct NETfieldCodec<uint64_t>
+{
+	enum { MaxLen = 10 };
+	static uint8_t *encode(uint8_t *out, uint64_t v)
+	{
+		out = NETfieldCodec<uint32_t>::encode(out, uint32_t(v >> 32));
+		return NETfieldCodec<uint32_t>::encode(out, uint32_t(v));
+	}
+	static const uint8_t *decode(const uint8_t *in, uint64_t &v)
+	{
+		uint32_t b[2];
+		in = NETfieldCodec<uint32_t>::decode(in, b[0]);
+		in = NETfieldCodec<uint32_t>::decode(in, b[1]);
+		v = uint64_t(b[0]) << 32 | b[1];
+		return in;
+	}
+};
+template <> struct NETfieldCodec<int64_t>
+{
+	enum { MaxLen = 10 };
+	static uint8_t *encode(uint8_t *out, int64_t v)
+	{
+		return NETfieldCodec<uint64_t>::encode(out, v);
+	}
+	static const uint8_t *decode(const uint8_t *in, int64_t &v)
+	{
+		uint64_t b;
+		in = NETfieldCodec<uint64_t>::decode(in, b);
+		v = b;
+		return in;
+	}
+};
+
+/// Same as calling NETauto() on each field in turn, but reserves space for the whole layout up front when encoding, and bounds checks once when decoding.
+/// Use for small fixed layouts sent every tick, such as GAME_GAME_TIME.
+template <typename... Fields>
+static inline void NETfields(Fields &... fields)
+{
+	constexpr size_t maxLen = (static_cast<size_t>(NETfieldCodec<Fields>::MaxLen) + ...);
+	if (NETgetPacketDir() == PACKET_ENCODE)
+	{
+		uint8_t *begin = NETreserveEncodeBytes(maxLen);
+		uint8_t *out = begin;
+		((out = NETfieldCodec<Fields>::encode(out, fields)), ...);
+		NETunreserveEncodeBytes(maxLen - (out - begin));
+	}
+	else if (NETgetPacketDir() == PACKET_DECODE)
+	{
+		size_t available;
+		const uint8_t *begin = NETpeekDecodeBytes(available);
+		if (available >= maxLen)
+		{
+			const uint8_t *in = begin;
+			((in = NETfieldCodec<Fields>::decode(in, fields)), ...);
+			NETskipDecodeBytes(in - begin);
+		}
+		else
+		{
+			// Might run off the end of the message, so use the checked version.
+			(NETauto(fields), ...);
+		}
+	}
+}
+
 void NETnetMessage(NetMessage const **message);  ///< If decoding, must delete the NETMESSAGE.
 
 #include <3rdparty/json/json_fwd.hpp>
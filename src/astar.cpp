@@ -56,9 +56,6 @@ bool isHumanPlayer(unsigned);
 Vector2i map_coord(Vector2i);
 
 
-/// Game time for all blocking maps in fpathBlockingMaps.
-static unsigned fpathCurrentGameTime;
-
 static constexpr auto AUXBITS_THREAT = 0x20; ///< Can hostile players shoot here?
 
 PathCoord::PathCoord(int x, int y)
@@ -165,10 +162,10 @@ bool PathContext::matches(PathBlockingMap& blocking, PathCoord start, NonBlockin
   dest == destination_bounds;
 }
 
-void fpathHardTableReset()
+void fpathHardTableReset(PathBlockingMaps& blocking_maps)
 {
-  path_contexts.clear();
-  blocking_maps.clear();
+  blocking_maps.maps.clear();
+  blocking_maps.game_time = 0;
 }
 
 PathNode getBestNode(std::vector<PathNode>& nodes)
@@ -375,7 +372,7 @@ PathCoord findNearestExploredTile(PathContext& context, PathCoord tile)
   return nearest_coord;
 }
 
-ASTAR_RESULT fpathAStarRoute(Movement& movement, PathJob& pathJob)
+ASTAR_RESULT fpathAStarRoute(std::vector<PathContext>& pathContexts, Movement& movement, PathJob& pathJob)
 {
   PathCoord end {};
   auto result = ASTAR_RESULT::OK;
@@ -389,7 +386,7 @@ ASTAR_RESULT fpathAStarRoute(Movement& movement, PathJob& pathJob)
 
   auto const dstIgnore = NonBlockingArea{pathJob.dstStructure};
 
-  auto it = std::find_if(path_contexts.begin(), path_contexts.end(),
+  auto it = std::find_if(pathContexts.begin(), pathContexts.end(),
                          [&origin_tile, &end, &must_reverse](auto& context) {
       if (context.map[origin_tile.x + origin_tile.y * mapWidth].iteration ==
           context.map[origin_tile.x + origin_tile.y * mapWidth].visited) {
@@ -415,10 +412,10 @@ ASTAR_RESULT fpathAStarRoute(Movement& movement, PathJob& pathJob)
       return true;
   });
 
-  if (it == path_contexts.end()) {
+  if (it == pathContexts.end()) {
     // did not find an appropriate route so make one
-    if (path_contexts.size() < 30) {
-      path_contexts.emplace_back(PathContext());
+    if (pathContexts.size() < 30) {
+      pathContexts.emplace_back(PathContext());
     }
 
     /**
@@ -502,32 +499,32 @@ ASTAR_RESULT fpathAStarRoute(Movement& movement, PathJob& pathJob)
   }
 
   // move context to beginning of last recently used list.
-  if (it != path_contexts.begin())  {
-    path_contexts.insert(path_contexts.begin(), *it);
+  if (it != pathContexts.begin())  {
+    pathContexts.insert(pathContexts.begin(), *it);
   }
 
   movement.destination = movement.path[route.size() - 1];
   return result;
 }
 
-void fpathSetBlockingMap(PathJob& path_job)
+void fpathSetBlockingMap(PathBlockingMaps& blocking_maps, PathJob& path_job)
 {
-	if (fpathCurrentGameTime != gameTime)  {
+	if (blocking_maps.game_time != gameTime)  {
 		// new tick, remove maps which are no longer needed.
-		fpathCurrentGameTime = gameTime;
-		blocking_maps.clear();
+		blocking_maps.game_time = gameTime;
+		blocking_maps.maps.clear();
 	}
 
 	// figure out which map we are looking for.
   path_job.moveType.gameTime = gameTime;
 
 	// find the map.
-	auto it = std::find_if(blocking_maps.begin(), blocking_maps.end(),
+	auto it = std::find_if(blocking_maps.maps.begin(), blocking_maps.maps.end(),
 	                      [&path_job](PathBlockingMap const& map) {
     return map == path_job.moveType;
   });
 
-  if (it != blocking_maps.end()) {
+  if (it != blocking_maps.maps.end()) {
     syncDebug("blockingMap(%d,%d,%d,%d) = cached", gameTime, path_job.moveType.propulsion,
               path_job.moveType.player, path_job.moveType.moveType);
     path_job.blockingMap = std::make_unique<PathBlockingMap>(*it);
@@ -536,7 +533,7 @@ void fpathSetBlockingMap(PathJob& path_job)
 
   // didn't find the map, so i does not point to a map.
   auto blocking = PathBlockingMap();
-  blocking_maps.emplace_back(blocking);
+  blocking_maps.maps.emplace_back(blocking);
 
   // `blocking` now points to an empty map with no data. fill the map.
   blocking.type = path_job.moveType;
@@ -571,7 +568,7 @@ void fpathSetBlockingMap(PathJob& path_job)
             path_job.moveType.propulsion, path_job.moveType.player,
             path_job.moveType.moveType, checksum_map, checksum_threat_map);
 
-  path_job.blockingMap = std::make_unique<PathBlockingMap>(blocking_maps.back());
+  path_job.blockingMap = std::make_unique<PathBlockingMap>(blocking_maps.maps.back());
 }
 
 bool PathBlockingMap::operator==(PathBlockingType const& rhs) const
@@ -162,7 +162,15 @@ struct PathBlockingMap
   PathBlockingType type;
   std::vector<bool> map;
   std::vector<bool> threat_map;
-}; extern std::vector<PathBlockingMap> blocking_maps;
+};
+
+/// Blocking maps generated during one game tick, for reuse by the other path jobs of that tick
+struct PathBlockingMaps
+{
+  /// Game time all of `maps` were generated at
+  unsigned game_time = 0;
+  std::vector<PathBlockingMap> maps;
+};
 
 /// Main pathfinding data structure. Represents a candidate route
 struct PathContext
@@ -203,21 +211,21 @@ struct PathContext
   std::unique_ptr<PathBlockingMap> blocking_map;
   /// Destination structure bounds that may be considered non-blocking
   NonBlockingArea destination_bounds;
-}; extern std::vector<PathContext> path_contexts;
+};
 
 /**
  * Call from the main thread. Sets `path_job.blocking_map` for later use by
  * the pathfinding thread, generating the required map if not already generated.
  */
-void fpathSetBlockingMap(PathJob& path_job);
+void fpathSetBlockingMap(PathBlockingMaps& blocking_maps, PathJob& path_job);
 
 /**
- * Clear the global path contexts and blocking maps
+ * Clear the blocking maps of one path finding context
  *
  * @note Call this on shutdown to prevent memory from leaking,
  *   or if loading/saving, to prevent stale data from being reused
  */
-void fpathHardTableReset();
+void fpathHardTableReset(PathBlockingMaps& blocking_maps);
 
 /// Finds the current best node, and removes it from the node heap
 PathNode getBestNode(std::vector<PathNode>& nodes);
@@ -240,8 +248,9 @@ PathCoord findNearestExploredTile(PathContext& context, PathCoord tile);
 
 /**
  * Use the A* algorithm to find a path
+ * @param pathContexts Previous explorations to reuse, most recently used first. Owned by the calling path finding thread.
  * @return Whether we successfully found a path
  */
-ASTAR_RESULT fpathAStarRoute(Movement& movement, PathJob& pathJob);
+ASTAR_RESULT fpathAStarRoute(std::vector<PathContext>& pathContexts, Movement& movement, PathJob& pathJob);
 
 #endif // __INCLUDED_SRC_ASTAR_H__
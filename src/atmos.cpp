@@ -23,6 +23,7 @@
  * Handles atmospherics such as snow and rain
 */
 
+#include <array>
 #include <glm/gtx/transform.hpp>
 #include "lib/ivis_opengl/piepalette.h"
 #include "wzmaplib/map.h"
@@ -40,162 +41,209 @@ bool gamePaused();
 
 /* Roughly one per tile */
 static constexpr auto	MAX_ATMOS_PARTICLES	= MAP_MAXWIDTH * MAP_MAXHEIGHT;
+static constexpr auto NUM_PARTICLE_TYPES = 2;
 static const auto SNOW_SPEED_DRIFT = 40 - rand() % 80;
 static const auto SNOW_SPEED_FALL = 0 - (rand() % 40 + 80);
 static const auto RAIN_SPEED_DRIFT = rand() % 50;
 static const auto RAIN_SPEED_FALL = 0 - (rand() % 300 + 700);
 
-static std::vector<Particle> asAtmosParts;
-static unsigned freeParticle;
+/**
+ * Fixed-capacity particle storage for one particle type, kept as a
+ * structure of arrays. Live particles are packed into [0, count), so
+ * the integration kernel below runs over contiguous floats without
+ * testing a status flag per slot; dead particles are swapped with the
+ * last live one.
+ */
+struct ParticlePool
+{
+  std::vector<float> posX, posY, posZ;
+  std::vector<float> velX, velY, velZ;
+  unsigned count = 0;
+
+  void allocate(unsigned capacity)
+  {
+    for (auto* v : {&posX, &posY, &posZ, &velX, &velY, &velZ})
+    {
+      v->resize(capacity);
+    }
+  }
+
+  void clear()
+  {
+    for (auto* v : {&posX, &posY, &posZ, &velX, &velY, &velZ})
+    {
+      v->clear();
+      v->shrink_to_fit();
+    }
+    count = 0;
+  }
+
+  [[nodiscard]] bool full() const
+  {
+    return count >= posX.size();
+  }
+
+  void add(Vector3f const& pos, Vector3f const& vel)
+  {
+    posX[count] = pos.x; posY[count] = pos.y; posZ[count] = pos.z;
+    velX[count] = vel.x; velY[count] = vel.y; velZ[count] = vel.z;
+    ++count;
+  }
+
+  void kill(unsigned i)
+  {
+    --count;
+    posX[i] = posX[count]; posY[i] = posY[count]; posZ[i] = posZ[count];
+    velX[i] = velX[count]; velY[i] = velY[count]; velZ[i] = velZ[count];
+  }
+};
+
+static std::array<ParticlePool, NUM_PARTICLE_TYPES> asAtmosParts;
 static WEATHER_TYPE weather = WEATHER_TYPE::NONE;
 
-/* Setup all the particles */
-void atmosInitSystem()
+static ParticlePool& particlePool(PARTICLE_TYPE type)
 {
-	if (asAtmosParts.empty() && weather != WEATHER_TYPE::NONE) {
-		asAtmosParts.resize(MAX_ATMOS_PARTICLES);
-	}
-  freeParticle = 0;
+  return asAtmosParts[static_cast<std::size_t>(type)];
 }
 
-/*	Makes a particle wrap around - if it goes off the grid, then it returns
-	on the other side - provided it's still on world... Which it should be */
-static void testParticleWrap(Particle* psPart)
+static iIMDShape* particleImd(PARTICLE_TYPE type)
 {
-	/* Gone off left side */
-	if (psPart->position.x < playerPos.p.x - world_coord(visibleTiles.x) / 2) {
-		psPart->position.x += world_coord(visibleTiles.x);
-	}
+  return getImdFromIndex(type == PARTICLE_TYPE::SNOW ? MI_SNOW : MI_RAIN);
+}
 
-	/* Gone off right side */
-	else if (psPart->position.x > playerPos.p.x + world_coord(visibleTiles.x) / 2) {
-		psPart->position.x -= world_coord(visibleTiles.x);
-	}
+static unsigned particleSize(PARTICLE_TYPE type)
+{
+  return type == PARTICLE_TYPE::SNOW ? 80 : 50;
+}
 
-	/* Gone off top */
-	if (psPart->position.z < playerPos.p.z - world_coord(visibleTiles.y) / 2) {
-		psPart->position.z += world_coord(visibleTiles.y);
-	}
+/* Setup all the particles */
+void atmosInitSystem()
+{
+  if (weather == WEATHER_TYPE::NONE) return;
 
-	/* Gone off bottom */
-	else if (psPart->position.z > playerPos.p.z + world_coord(visibleTiles.y) / 2) {
-		psPart->position.z -= world_coord(visibleTiles.y);
-	}
+  /* Split the old per-tile budget between the particle types */
+  for (auto& pool : asAtmosParts)
+  {
+    if (pool.posX.empty()) {
+      pool.allocate(MAX_ATMOS_PARTICLES / NUM_PARTICLE_TYPES);
+    }
+    pool.count = 0;
+  }
 }
 
-/* Moves one of the particles */
-static void processParticle(Particle* psPart)
+/*	Makes the particles wrap around - if they go off the grid, then they
+	return on the other side - provided they're still on world... Which
+	they should be. Branch-free so the loop vectorizes. */
+static void wrapParticles(float* WZ_DECL_RESTRICT pos, unsigned count, float centre, float extent)
 {
-	/* Only move if the game isn't paused */
-  if (gamePaused()) return;
-
-  /* Move the particle - frame rate controlled */
-  psPart->position.x += graphicsTimeAdjustedIncrement(psPart->velocity.x);
-  psPart->position.y += graphicsTimeAdjustedIncrement(psPart->velocity.y);
-  psPart->position.z += graphicsTimeAdjustedIncrement(psPart->velocity.z);
-
-  /* Wrap it around if it's gone off grid... */
-  testParticleWrap(psPart);
-
-  /* If it's gone off the WORLD... */
-  if (psPart->position.x < 0 || psPart->position.z < 0 ||
-      psPart->position.x > ((mapWidth - 1) * TILE_UNITS) ||
-      psPart->position.z > ((mapHeight - 1) * TILE_UNITS)) {
-    // then kill it
-    psPart->status = PARTICLE_STATUS::INACTIVE;
-    return;
+  const auto lo = centre - extent / 2;
+  const auto hi = centre + extent / 2;
+  for (auto i = 0u; i < count; ++i)
+  {
+    pos[i] += (pos[i] < lo ? extent : 0.f) - (pos[i] > hi ? extent : 0.f);
+  }
+}
+
+/* Moves all the particles of one type - frame rate controlled */
+static void integrateParticles(ParticlePool& pool)
+{
+  const auto dt = graphicsTimeAdjustedIncrement(1.f);
+  float* WZ_DECL_RESTRICT px = pool.posX.data();
+  float* WZ_DECL_RESTRICT py = pool.posY.data();
+  float* WZ_DECL_RESTRICT pz = pool.posZ.data();
+  const float* WZ_DECL_RESTRICT vx = pool.velX.data();
+  const float* WZ_DECL_RESTRICT vy = pool.velY.data();
+  const float* WZ_DECL_RESTRICT vz = pool.velZ.data();
+
+  for (auto i = 0u; i < pool.count; ++i)
+  {
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
   }
 
-  /* What height is the ground under it? Only do if low enough...*/
-  if (psPart->position.y < TILE_MAX_HEIGHT) {
-    /* Get ground height */
-    auto groundHeight = map_Height(static_cast<int>(psPart->position.x),
-                                   static_cast<int>(psPart->position.z));
+  /* Wrap them around if they've gone off grid... */
+  wrapParticles(px, pool.count, static_cast<float>(playerPos.p.x), static_cast<float>(world_coord(visibleTiles.x)));
+  wrapParticles(pz, pool.count, static_cast<float>(playerPos.p.z), static_cast<float>(world_coord(visibleTiles.y)));
+}
+
+/* Kills particles that left the world or hit the ground */
+static void collideParticles(ParticlePool& pool, PARTICLE_TYPE type)
+{
+  const auto maxX = static_cast<float>((mapWidth - 1) * TILE_UNITS);
+  const auto maxZ = static_cast<float>((mapHeight - 1) * TILE_UNITS);
+
+  for (auto i = 0u; i < pool.count; )
+  {
+    const auto x = pool.posX[i];
+    const auto y = pool.posY[i];
+    const auto z = pool.posZ[i];
+
+    /* If it's gone off the WORLD... then kill it */
+    if (x < 0 || z < 0 || x > maxX || z > maxZ) {
+      pool.kill(i);
+      continue;
+    }
+
+    /* What height is the ground under it? Only do if low enough...*/
+    if (y >= TILE_MAX_HEIGHT) {
+      ++i;
+      continue;
+    }
+
+    auto groundHeight = map_Height(static_cast<int>(x), static_cast<int>(z));
 
     /* Are we below ground? */
-    if (psPart->position.y < groundHeight || psPart->position.y < 0.f) {
-      /* Kill it and return */
-      psPart->status = PARTICLE_STATUS::INACTIVE;
-
-      if (psPart->type != PARTICLE_TYPE::RAIN)
-        return;
-
-      auto x = map_coord(static_cast<int>(psPart->position.x));
-      auto y = map_coord(static_cast<int>(psPart->position.z));
-      auto psTile = mapTile(x, y);
-      if (terrainType(psTile) == TER_WATER && TEST_TILE_VISIBLE_TO_SELECTEDPLAYER(psTile)) {
-        // display-only check for adding effect
-        auto pos = Position{psPart->position.x, groundHeight, psPart->position.z};
-        effectSetSize(60);
-        addEffect(&pos, EFFECT_GROUP::EXPLOSION,
-                  EFFECT_TYPE::EXPLOSION_TYPE_SPECIFIED,
-                  true, getImdFromIndex(MI_SPLASH), 0);
-      }
-      return;
+    if (y >= groundHeight && y >= 0.f) {
+      ++i;
+      continue;
     }
-  }
 
-  if (psPart->type != PARTICLE_TYPE::SNOW)
-    return;
+    /* Kill it */
+    pool.kill(i);
+
+    if (type != PARTICLE_TYPE::RAIN)
+      continue;
 
-  if (rand() % 30 == 1) {
-    psPart->velocity.z = (float)SNOW_SPEED_DRIFT;
+    auto psTile = mapTile(map_coord(static_cast<int>(x)), map_coord(static_cast<int>(z)));
+    if (terrainType(psTile) == TER_WATER && TEST_TILE_VISIBLE_TO_SELECTEDPLAYER(psTile)) {
+      // display-only check for adding effect
+      auto pos = Position{x, groundHeight, z};
+      effectSetSize(60);
+      addEffect(&pos, EFFECT_GROUP::EXPLOSION,
+                EFFECT_TYPE::EXPLOSION_TYPE_SPECIFIED,
+                true, getImdFromIndex(MI_SPLASH), 0);
+    }
   }
-  if (rand() % 30 == 1) {
-    psPart->velocity.x = (float)SNOW_SPEED_DRIFT;
+}
+
+/* Snow drifts about randomly */
+static void driftParticles(ParticlePool& pool)
+{
+  for (auto i = 0u; i < pool.count; ++i)
+  {
+    if (rand() % 30 == 1) {
+      pool.velZ[i] = (float)SNOW_SPEED_DRIFT;
+    }
+    if (rand() % 30 == 1) {
+      pool.velX[i] = (float)SNOW_SPEED_DRIFT;
+    }
   }
 }
 
 /* Adds a particle to the system if it can */
 static void atmosAddParticle(const Vector3f& pos, PARTICLE_TYPE type)
 {
-	unsigned activeCount;
-  int i;
-
-  for (i = freeParticle, activeCount = 0; asAtmosParts[i].status == PARTICLE_STATUS::ACTIVE &&
-                                          activeCount < MAX_ATMOS_PARTICLES; i++) {
-		activeCount++;
-		/* Check for wrap around */
-		if (i >= (MAX_ATMOS_PARTICLES - 1)) {
-			/* Go back to the first one */
-			i = 0;
-		}
-	}
+  auto& pool = particlePool(type);
 
-	/* Check the list isn't just full of essential effects */
-	if (activeCount >= MAX_ATMOS_PARTICLES - 1) {
-		/* All of the particles active!?!? */
-		return;
-	}
-	freeParticle = i;
-
-	/* Record it's type */
-	asAtmosParts[freeParticle].type = type;
-
-	/* Make it active */
-	asAtmosParts[freeParticle].status = PARTICLE_STATUS::ACTIVE;
-
-	/* Setup the imd */
-  switch (type) {
-    case PARTICLE_TYPE::SNOW:
-      asAtmosParts[freeParticle].imd = std::make_unique<iIMDShape>(*getImdFromIndex(MI_SNOW));
-      asAtmosParts[freeParticle].size = 80;
-      break;
-    case PARTICLE_TYPE::RAIN:
-      asAtmosParts[freeParticle].imd = std::make_unique<iIMDShape>(*getImdFromIndex(MI_RAIN));
-      asAtmosParts[freeParticle].size = 50;
-      break;
-	}
+  /* All of the particles active!?!? */
+  if (pool.full()) return;
 
-	/* Setup position */
-	asAtmosParts[freeParticle].position = pos;
-
-	/* Setup its velocity */
-	if (type == PARTICLE_TYPE::RAIN) {
-		asAtmosParts[freeParticle].velocity = Vector3f(RAIN_SPEED_DRIFT, RAIN_SPEED_FALL, RAIN_SPEED_DRIFT);
+  if (type == PARTICLE_TYPE::RAIN) {
+    pool.add(pos, Vector3f(RAIN_SPEED_DRIFT, RAIN_SPEED_FALL, RAIN_SPEED_DRIFT));
     return;
-	}
-  asAtmosParts[freeParticle].velocity = Vector3f(SNOW_SPEED_DRIFT, SNOW_SPEED_FALL, SNOW_SPEED_DRIFT);
+  }
+  pool.add(pos, Vector3f(SNOW_SPEED_DRIFT, SNOW_SPEED_FALL, SNOW_SPEED_DRIFT));
 }
 
 void atmosUpdateSystem()
@@ -206,11 +254,13 @@ void atmosUpdateSystem()
   if (gamePaused() || weather == WEATHER_TYPE::NONE)
     return;
 
-  for (auto i = 0; i < MAX_ATMOS_PARTICLES; i++)
+  for (auto type : {PARTICLE_TYPE::RAIN, PARTICLE_TYPE::SNOW})
   {
-    /* See if it's active */
-    if (asAtmosParts[i].status == PARTICLE_STATUS::ACTIVE) {
-      processParticle(&asAtmosParts[i]);
+    auto& pool = particlePool(type);
+    integrateParticles(pool);
+    collideParticles(pool, type);
+    if (type == PARTICLE_TYPE::SNOW) {
+      driftParticles(pool);
     }
   }
 
@@ -246,6 +296,7 @@ void atmosUpdateSystem()
     switch (weather) {
       case WEATHER_TYPE::SNOWING:
         atmosAddParticle(pos, PARTICLE_TYPE::SNOW);
+        break;
       case WEATHER_TYPE::RAINING:
         atmosAddParticle(pos, PARTICLE_TYPE::RAIN);
         break;
@@ -255,45 +306,51 @@ void atmosUpdateSystem()
   }
 }
 
-void atmosDrawParticles(const glm::mat4& viewMatrix)
+/* Queues every visible particle of one type for the opaque pass. All of
+   them share one shape, frame and camera-facing rotation, so only the
+   translation differs. pie_Draw3DShape() only queues the shape; where the
+   backend supports instanced draws, pie_RemainingPasses() then draws all
+   particles of a type with one instanced call. Otherwise each particle is
+   still its own draw call. */
+static void drawParticles(ParticlePool const& pool, PARTICLE_TYPE type, glm::mat4 const& viewMatrix)
 {
-	if (weather == WEATHER_TYPE::NONE) {
-		return;
-	}
+  if (pool.count == 0) return;
 
-	/* Traverse the list */
-	for (auto i = 0; i < MAX_ATMOS_PARTICLES; i++)
-	{
-		/* Don't bother unless it's active */
-    if (asAtmosParts[i].status != PARTICLE_STATUS::ACTIVE)
-      continue;
+  auto imd = particleImd(type);
+	/* Make it face camera */
+	/* Scale it... */
+  auto modelMatrix = glm::rotate(UNDEG(-playerPos.r.y), glm::vec3(0.f, 1.f, 0.f)) *
+		glm::rotate(UNDEG(-playerPos.r.x), glm::vec3(0.f, 1.f, 0.f)) *
+		glm::scale(glm::vec3(particleSize(type) / 100.f));
 
+  for (auto i = 0u; i < pool.count; ++i)
+  {
     /* Is it visible on the screen? */
-    if (clipXYZ(static_cast<int>(asAtmosParts[i].position.x),
-                static_cast<int>(asAtmosParts[i].position.z),
-                static_cast<int>(asAtmosParts[i].position.y), viewMatrix)) {
-      renderParticle(&asAtmosParts[i], viewMatrix);
+    if (!clipXYZ(static_cast<int>(pool.posX[i]), static_cast<int>(pool.posZ[i]),
+                 static_cast<int>(pool.posY[i]), viewMatrix)) {
+      continue;
     }
+
+    /* Transform it */
+    modelMatrix[3] = glm::vec4(pool.posX[i] - playerPos.p.x,
+                               pool.posY[i],
+                               -(pool.posZ[i] - playerPos.p.z), 1.f);
+
+    pie_Draw3DShape(imd, 0, 0, WZCOL_WHITE,
+                    0, 0, viewMatrix * modelMatrix);
   }
 }
 
-void renderParticle(Particle const* psPart, glm::mat4 const& viewMatrix)
+void atmosDrawParticles(const glm::mat4& viewMatrix)
 {
-	static glm::vec3 dv;
-
-	/* Transform it */
-	dv.x = psPart->position.x - playerPos.p.x;
-	dv.y = psPart->position.y;
-	dv.z = -(psPart->position.z - playerPos.p.z);
-	/* Make it face camera */
-	/* Scale it... */
-	auto const modelMatrix = glm::translate(dv) *
-		glm::rotate(UNDEG(-playerPos.r.y), glm::vec3(0.f, 1.f, 0.f)) *
-		glm::rotate(UNDEG(-playerPos.r.x), glm::vec3(0.f, 1.f, 0.f)) *
-		glm::scale(glm::vec3(psPart->size / 100.f));
+	if (weather == WEATHER_TYPE::NONE) {
+		return;
+	}
 
-	pie_Draw3DShape(psPart->imd.get(), 0, 0, WZCOL_WHITE,
-                  0, 0, viewMatrix * modelMatrix);
+  for (auto type : {PARTICLE_TYPE::RAIN, PARTICLE_TYPE::SNOW})
+  {
+    drawParticles(particlePool(type), type, viewMatrix);
+  }
 }
 
 void atmosSetWeatherType(WEATHER_TYPE type)
@@ -302,8 +359,11 @@ void atmosSetWeatherType(WEATHER_TYPE type)
 		weather = type;
 		atmosInitSystem();
 	}
-	if (type == WEATHER_TYPE::NONE && !asAtmosParts.empty()) {
-    asAtmosParts.clear();
+	if (type == WEATHER_TYPE::NONE) {
+    for (auto& pool : asAtmosParts)
+    {
+      pool.clear();
+    }
 	}
 }
 
@@ -38,27 +38,11 @@ enum class PARTICLE_TYPE
   SNOW
 };
 
-enum class PARTICLE_STATUS
-{
-  INACTIVE,
-  ACTIVE
-};
-
-struct Particle
-{
-	PARTICLE_STATUS status;
-	PARTICLE_TYPE type;
-	unsigned size;
-	Vector3f position;
-	Vector3f velocity;
-	std::unique_ptr<iIMDShape> imd;
-};
-
 [[nodiscard]] WEATHER_TYPE atmosGetWeatherType();
 void atmosInitSystem();
 /// Move the particles
 void atmosUpdateSystem();
-void renderParticle(Particle const* psPart, glm::mat4 const& viewMatrix);
+/// Queue all visible particles for drawing (one instanced draw per particle type where supported)
 void atmosDrawParticles(glm::mat4 const& viewMatrix);
 void atmosSetWeatherType(WEATHER_TYPE type);
 
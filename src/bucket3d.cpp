@@ -21,16 +21,20 @@
 /**
  * @file bucket3d.cpp
  *
- * Stores object render calls in a linked list renders
- * after bucket sorting objects
+ * Stores object render calls in per-frame render queues and renders
+ * them after sorting: opaque objects grouped by texture and mesh,
+ * depth-sorted objects back to front
  */
 
+#include <algorithm>
+#include <array>
+#include <functional>
 #include <vector>
 
 #include "lib/framework/fixedpoint.h"
 #include "lib/framework/vector.h"
+#include "lib/ivis_opengl/piematrix.h"
 
-#include "atmos.h"
 #include "bucket3d.h"
 #include "component.h"
 #include "display3d.h"
@@ -45,344 +49,327 @@ struct BodyStats;
 struct Droid;
 struct iIMDShape;
 struct BaseObject;
-int pie_RotateProject(const Vector3i*, const glm::mat4&, Vector2i*);
-static std::vector<BUCKET_TAG> bucketArray;
 
+static constexpr auto SCALE_DEPTH = FP12_MULTIPLIER * 7;
+static constexpr auto CLIP_LEFT = 0;
+static constexpr auto CLIP_TOP = 0;
 
-BUCKET_TAG::BUCKET_TAG(RENDER_TYPE objectType, void* objPtr, int z)
-  : objectType{objectType}, pObject{objPtr}, actualZ{z}
-{
-}
+/// Same as the hack factor in pie_RotateProject()
+static constexpr auto MIN_PROJECTED_W = 256.f / (3 * 330);
 
-bool BUCKET_TAG::operator<(BUCKET_TAG const& b) const
+/// Depth is quantized to this many bits for the transparent queue radix sort
+static constexpr auto DEPTH_KEY_BITS = 16;
+static constexpr auto DEPTH_KEY_SHIFT = 2;
+static constexpr auto RADIX_BITS = 8;
+static constexpr auto RADIX_BUCKETS = 1 << RADIX_BITS;
+
+/// Where an object goes once it has been projected
+enum class RENDER_QUEUE
+{
+  /// Drawn first, grouped by texture page then mesh
+  OPAQUE_OBJECTS,
+  /// Drawn after the opaque queue, back to front
+  TRANSPARENT_OBJECTS
+};
+
+/// An object waiting to be projected and queued
+struct BucketCandidate
 {
-  return actualZ > b.actualZ; // sort in reverse z order
+  RENDER_TYPE objectType;
+  void* pObject;
+  RENDER_QUEUE queue;
+  const iIMDShape* pie; // mesh used for clipping radius and opaque batching
+  Vector3i position; // camera-relative position
+  int radius; // world space clipping radius, negative to skip the screen test
+  int zBias; // subtracted from the projected depth
+  int texpage; // opaque sort key
+};
+
+struct BucketTag
+{
+  RENDER_TYPE objectType;
+  void* pObject;
+  const iIMDShape* pie;
+  uint32_t key;
+};
+
+static std::vector<BucketCandidate> bucketCandidates;
+static std::vector<BucketTag> opaqueQueue;
+static std::vector<BucketTag> transparentQueue;
+static std::vector<BucketTag> radixScratch;
+
+static Vector3i cameraRelative(int x, int y, int z)
+{
+  return {x - playerPos.p.x, z, -(y - playerPos.p.z)};
 }
 
-static int bucketCalculateZ(RENDER_TYPE objectType, void* pObject, glm::mat4 const& viewMatrix)
+/// Fill in everything about an object that does not need the projection.
+/// Returns false if the object is never drawn through the buckets.
+static bool bucketDescribe(BucketCandidate& candidate)
 {
-	int z = 0, radius;
-	Vector2i pixel(0, 0);
-	Vector3i position(0, 0, 0);
-	unsigned droidSize;
-	BodyStats const* psBStats;
+  auto pObject = candidate.pObject;
   BaseObject* psSimpObj;
-	iIMDShape* pImd;
-	Spacetime spacetime;
+  candidate.queue = RENDER_QUEUE::TRANSPARENT_OBJECTS;
+  candidate.pie = nullptr;
+  candidate.zBias = 0;
+  candidate.texpage = 0;
 
-	switch (objectType) {
+  switch (candidate.objectType) {
     using enum RENDER_TYPE;
-	  case RENDER_PARTICLE:
-	  	position.x = static_cast<int>(((Particle*)pObject)->position.x);
-	  	position.y = static_cast<int>(((Particle*)pObject)->position.y);
-	  	position.z = static_cast<int>(((Particle*)pObject)->position.z);
-
-	  	position.x = position.x - playerPos.p.x;
-	  	position.z = -(position.z - playerPos.p.z);
-
-      /* 16 below is HACK!!! */
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel) - 16;
-      if (z <= 0) break;
-
-      //particle use the image radius
-      radius = ((Particle*)pObject)->imd->radius;
-      radius *= SCALE_DEPTH;
-      radius /= z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
-      }
-      break;
-
 	  case RENDER_PROJECTILE: {
       auto psProj = static_cast<Projectile*>(pObject);
       if (psProj && (psProj->getWeaponStats()->weaponSubClass == WEAPON_SUBCLASS::FLAME ||
                      psProj->getWeaponStats()->weaponSubClass == WEAPON_SUBCLASS::COMMAND ||
                      psProj->getWeaponStats()->weaponSubClass == WEAPON_SUBCLASS::EMP)) {
         /* We don't do projectiles from these guys, cos there's an effect instead */
-        z = -1;
-        break;
+        return false;
       }
       //the weapon stats holds the reference to which graphic to use
-      pImd = psProj->getWeaponStats()->pInFlightGraphic;
+      candidate.pie = psProj->getWeaponStats()->pInFlightGraphic;
+      candidate.radius = candidate.pie->radius;
 
       psSimpObj = static_cast<BaseObject*>(pObject);
-      position.x = psSimpObj->getPosition().x - playerPos.p.x;
-      position.z = -(psSimpObj->getPosition().y - playerPos.p.z);
-      position.y = psSimpObj->getPosition().z;
-
-      z = pie_RotateProject(&position, viewMatrix, &pixel);
-
-      if (z <= 0)
-        break;
+      candidate.position = cameraRelative(psSimpObj->getPosition().x, psSimpObj->getPosition().y,
+                                          psSimpObj->getPosition().z);
+      return true;
+    }
 
-      //particle use the image radius
-      radius = pImd->radius * SCALE_DEPTH / z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
+	  case RENDER_STRUCTURE: {
+      auto psStruct = static_cast<Structure*>(pObject);
+      candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+      candidate.pie = psStruct->getDisplayData()->imd_shape.get();
+      candidate.texpage = candidate.pie->texpage;
+      //walls guntowers and tank traps clip tightly
+      candidate.radius = candidate.pie->radius;
+      candidate.position = cameraRelative(psStruct->getPosition().x, psStruct->getPosition().y,
+                                          psStruct->getPosition().z);
+      if (psStruct->getStats()->type == STRUCTURE_TYPE::DEFENSE ||
+          psStruct->getStats()->type == STRUCTURE_TYPE::WALL ||
+          psStruct->getStats()->type == STRUCTURE_TYPE::WALL_CORNER) {
+        candidate.position.y += 64;
       }
-      break;
+      return true;
     }
 
-	  case RENDER_STRUCTURE: //not depth sorted
-	  	psSimpObj = (BaseObject*)pObject;
-	  	position.x = psSimpObj->getPosition().x - playerPos.p.x;
-	  	position.z = -(psSimpObj->getPosition().y - playerPos.p.z);
+	  case RENDER_FEATURE: {
+      auto psFeature = static_cast<Feature*>(pObject);
+      candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+      candidate.pie = psFeature->getDisplayData()->imd_shape.get();
+      candidate.texpage = candidate.pie->texpage;
+      candidate.radius = candidate.pie->radius;
+      candidate.position = cameraRelative(psFeature->getPosition().x, psFeature->getPosition().y,
+                                          psFeature->getPosition().z + 2);
+      return true;
+    }
+
+	  case RENDER_DROID: {
+      auto psDroid = static_cast<Droid*>(pObject);
+      candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+      candidate.pie = BODY_IMD(psDroid, 0);
+      candidate.texpage = candidate.pie->texpage;
+      auto psBStats = dynamic_cast<BodyStats const *>(psDroid->getComponent(COMPONENT_TYPE::BODY));
+      candidate.radius = psBStats->pIMD->radius;
+      candidate.zBias = candidate.radius * 2;
+      candidate.position = cameraRelative(psDroid->getPosition().x, psDroid->getPosition().y,
+                                          psDroid->getPosition().z);
+      return true;
+    }
 
-	  	if (((Structure *) pObject)->getStats()->type == STRUCTURE_TYPE::DEFENSE ||
-          ((Structure *) pObject)->getStats()->type == STRUCTURE_TYPE::WALL ||
-          ((Structure *) pObject)->getStats()->type == STRUCTURE_TYPE::WALL_CORNER) {
-	  		position.y = psSimpObj->getPosition().z + 64;
-	  		radius = ((Structure*)pObject)->getDisplayData()->imd_shape->radius; //walls guntowers and tank traps clip tightly
+	  case RENDER_PROXMSG: {
+      auto ptr = static_cast<PROXIMITY_DISPLAY*>(pObject);
+	  	if (ptr->type == POSITION_TYPE::POS_PROXDATA) {
+        auto psViewProx = (VIEW_PROXIMITY*)ptr->psMessage->pViewData->pData;
+        candidate.position = cameraRelative(psViewProx->x, psViewProx->y, psViewProx->z);
 	  	}
-	  	else {
-	  		position.y = psSimpObj->getPosition().z;
-        radius = ((Structure *) pObject)->getDisplayData()->imd_shape->radius;
+	  	else if (ptr->type == POSITION_TYPE::POS_PROXOBJ) {
+        auto const& pos = ptr->psMessage->psObj->getPosition();
+        candidate.position = cameraRelative(pos.x, pos.y, pos.z);
 	  	}
-
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel);
-
-	  	if (z <= 0)
-        break;
-
-      //particle use the image radius
-      radius *= SCALE_DEPTH;
-      radius /= z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || (pixel.y - radius > CLIP_BOTTOM)) {
-        z = -1;
+      else {
+        candidate.position = Vector3i(0, 0, 0);
       }
-	  	break;
-
-	  case RENDER_FEATURE: //not depth sorted
-	  	psSimpObj = static_cast<BaseObject*>(pObject);
-      position = {psSimpObj->getPosition().x - playerPos.p.x,
-                  psSimpObj->getPosition().z + 2,
-                  -(psSimpObj->getPosition().y - playerPos.p.z)};
-
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel);
-
-	  	if (z <= 0)
-        break;
+      //use MI_BLIP_ENEMY as all are same radius
+      candidate.pie = getImdFromIndex(MI_BLIP_ENEMY);
+      candidate.radius = candidate.pie->radius;
+      return true;
+    }
 
-      //particle use the image radius
-      radius = ((Feature*)pObject)->getDisplayData()->imd_shape->radius;
-      radius *= SCALE_DEPTH;
-      radius /= z;
+    case RENDER_EFFECT: {
+      auto psEffect = static_cast<EFFECT*>(pObject);
+      candidate.position = Vector3i(static_cast<int>(psEffect->position.x - playerPos.p.x),
+                                    static_cast<int>(psEffect->position.y),
+                                    static_cast<int>(-(psEffect->position.z - playerPos.p.z)));
+      /* 16 below is HACK!!! */
+      candidate.zBias = 16;
+      candidate.pie = psEffect->imd.get();
+      candidate.radius = candidate.pie ? candidate.pie->radius : -1;
 
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
+      switch (psEffect->group) {
+        using enum EFFECT_GROUP;
+        case EXPLOSION:
+        case CONSTRUCTION:
+        case SMOKE:
+        case FIREWORK:
+          // Use calculated Z
+          break;
+        case WAYPOINT:
+          candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+          candidate.texpage = candidate.pie->texpage;
+          break;
+        default:
+          candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+          candidate.texpage = 42;
+          break;
       }
-	  	break;
+      return true;
+    }
 
-	  case RENDER_DROID:
-    {
-      auto psDroid = static_cast<Droid*>(pObject);
-      psSimpObj = static_cast<BaseObject*>(pObject);
-      position.x = psSimpObj->getPosition().x - playerPos.p.x;
-      position.z = -(psSimpObj->getPosition().y - playerPos.p.z);
-      position.y = psSimpObj->getPosition().z;
-
-      psBStats = dynamic_cast<BodyStats const *>(psDroid->getComponent(COMPONENT_TYPE::BODY));
-      droidSize = psBStats->pIMD->radius;
-      z = pie_RotateProject(&position, viewMatrix, &pixel) - (droidSize * 2);
-
-      if (z <= 0)
-        break;
-
-      //particle use the image radius
-      radius = droidSize * SCALE_DEPTH / z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
-      }
-      break;
+    case RENDER_DELIVPOINT: {
+      auto psFlag = static_cast<FlagPosition*>(pObject);
+      candidate.queue = RENDER_QUEUE::OPAQUE_OBJECTS;
+      candidate.pie = pAssemblyPointIMDs[psFlag->factoryType][psFlag->factoryInc];
+      candidate.texpage = candidate.pie->texpage;
+      candidate.radius = candidate.pie->radius;
+      candidate.position = cameraRelative(psFlag->coords.x, psFlag->coords.y, psFlag->coords.z);
+      return true;
     }
+    default:
+	  	return false;
+	}
+}
 
-	  case RENDER_PROXMSG:
-	  	if (((PROXIMITY_DISPLAY*)pObject)->type == POSITION_TYPE::POS_PROXDATA) {
-	  		auto ptr = (PROXIMITY_DISPLAY*)pObject;
-	  		position.x = ((VIEW_PROXIMITY*)ptr->psMessage->pViewData->pData)->x - playerPos.p.x;
-	  		position.z = -(((VIEW_PROXIMITY*)ptr->psMessage->pViewData->pData)->y - playerPos.p.z);
-	  		position.y = ((VIEW_PROXIMITY*)ptr->psMessage->pViewData->pData)->z;
-	  	}
-	  	else if (((PROXIMITY_DISPLAY*)pObject)->type == POSITION_TYPE::POS_PROXOBJ) {
-	  		auto ptr = (PROXIMITY_DISPLAY*)pObject;
-	  		position.x = ptr->psMessage->psObj->getPosition().x - playerPos.p.x;
-	  		position.z = -(ptr->psMessage->psObj->getPosition().y - playerPos.p.z);
-	  		position.y = ptr->psMessage->psObj->getPosition().z;
-	  	}
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel);
+/* add an object to the current render list */
+void bucketAddTypeToList(RENDER_TYPE objectType, void* pObject, const glm::mat4&)
+{
+  BucketCandidate candidate;
+  candidate.objectType = objectType;
+  candidate.pObject = pObject;
+  if (bucketDescribe(candidate)) {
+    bucketCandidates.push_back(candidate);
+  }
+}
 
-      if (z <= 0)
-        break;
+/// Project every candidate with a single combined matrix, clip it against
+/// the screen and move the survivors into the opaque or transparent queue
+static void bucketProjectCandidates(const glm::mat4& viewMatrix)
+{
+  const auto mvp = pie_PerspectiveGet() * viewMatrix;
+  const auto width = static_cast<float>(pie_GetVideoBufferWidth());
+  const auto height = static_cast<float>(pie_GetVideoBufferHeight());
+  const auto clipRight = pie_GetVideoBufferWidth();
+  const auto clipBottom = pie_GetVideoBufferHeight();
 
-      //particle use the image radius
-      pImd = getImdFromIndex(MI_BLIP_ENEMY);//use MI_BLIP_ENEMY as all are same radius
-      radius = pImd->radius * SCALE_DEPTH / z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
-      }
+  for (auto const& candidate : bucketCandidates)
+  {
+    const auto v = mvp * glm::vec4(candidate.position, 1.f);
+    auto z = static_cast<int>(v.w) - candidate.zBias;
+
+    bool visible = z >= 0;
+    if (z > 0 && candidate.radius >= 0) {
+      const auto pixelX = static_cast<int>((.5f + .5f * v.x / v.w) * width);
+      const auto pixelY = static_cast<int>((.5f - .5f * v.y / v.w) * height);
+      const auto radius = candidate.radius * SCALE_DEPTH / z;
+      visible = v.w >= MIN_PROJECTED_W &&
+                !(pixelX + radius < CLIP_LEFT || pixelX - radius > clipRight ||
+                  pixelY + radius < CLIP_TOP || pixelY - radius > clipBottom);
+    }
 
-    case RENDER_EFFECT:
-	  	position.x = static_cast<int>(((EFFECT*)pObject)->position.x - playerPos.p.x);
-	  	position.z = static_cast<int>(-(((EFFECT*)pObject)->position.z - playerPos.p.z));
-	  	position.y = static_cast<int>(((EFFECT*)pObject)->position.y);
-
-	  /* 16 below is HACK!!! */
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel) - 16;
-
-      if (z <= 0)
-        break;
-
-      //particle use the image radius
-      pImd = ((EFFECT*)pObject)->imd.get();
-      if (pImd == nullptr)
-        break;
-
-      radius = pImd->radius;
-      radius *= SCALE_DEPTH;
-      radius /= z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
+    if (!visible) {
+      /* Object will not be rendered - has been clipped! */
+      if (candidate.objectType == RENDER_TYPE::RENDER_DROID ||
+          candidate.objectType == RENDER_TYPE::RENDER_STRUCTURE) {
+        /* Won't draw selection boxes */
+        static_cast<BaseObject*>(candidate.pObject)->setFrameNumber(0);
       }
-      break;
+      continue;
+    }
 
-    case RENDER_DELIVPOINT:
-	  	position.x = ((FlagPosition*)pObject)->coords.x - playerPos.p.x;
-	  	position.z = -(((FlagPosition*)pObject)->coords.y - playerPos.p.z);
-	  	position.y = ((FlagPosition*)pObject)->coords.z;
-
-	  	z = pie_RotateProject(&position, viewMatrix, &pixel);
-
-      if (z <= 0)
-        break;
-
-      //particle use the image radius
-      radius = pAssemblyPointIMDs[((FlagPosition*)pObject)->factoryType][((FlagPosition*)pObject)->factoryInc]->radius;
-      radius *= SCALE_DEPTH;
-      radius /= z;
-      if (pixel.x + radius < CLIP_LEFT || pixel.x - radius > CLIP_RIGHT ||
-          pixel.y + radius < CLIP_TOP || pixel.y - radius > CLIP_BOTTOM) {
-        z = -1;
-      }
-      break;
-    default:
-	  	break;
-	}
-	return z;
+    if (candidate.queue == RENDER_QUEUE::OPAQUE_OBJECTS) {
+      opaqueQueue.push_back({candidate.objectType, candidate.pObject, candidate.pie,
+                             static_cast<uint32_t>(candidate.texpage)});
+      continue;
+    }
+    // Farthest first, so invert the quantized depth
+    const auto depth = std::min<uint32_t>(static_cast<uint32_t>(z) >> DEPTH_KEY_SHIFT,
+                                          (1u << DEPTH_KEY_BITS) - 1);
+    transparentQueue.push_back({candidate.objectType, candidate.pObject, candidate.pie,
+                                ((1u << DEPTH_KEY_BITS) - 1) - depth});
+  }
+  bucketCandidates.clear();
 }
 
-/* add an object to the current render list */
-void bucketAddTypeToList(RENDER_TYPE objectType, void* pObject, const glm::mat4& viewMatrix)
+/// Stable LSD radix sort on the low DEPTH_KEY_BITS of the key
+static void bucketRadixSort(std::vector<BucketTag>& tags)
 {
-	const iIMDShape* pie;
-	auto z = bucketCalculateZ(objectType, pObject, viewMatrix);
-
-	if (z < 0) {
-		/* Object will not be rendered - has been clipped! */
-		if (objectType == RENDER_TYPE::RENDER_DROID || objectType == RENDER_TYPE::RENDER_STRUCTURE) {
-			/* Won't draw selection boxes */
-			((BaseObject *)pObject)->setFrameNumber(0);
-		}
-		return;
-	}
+  radixScratch.resize(tags.size());
+  for (auto shift = 0; shift < DEPTH_KEY_BITS; shift += RADIX_BITS)
+  {
+    std::array<size_t, RADIX_BUCKETS + 1> offsets {};
+    for (auto const& tag : tags)
+    {
+      ++offsets[((tag.key >> shift) & (RADIX_BUCKETS - 1)) + 1];
+    }
+    for (auto i = 1; i <= RADIX_BUCKETS; ++i)
+    {
+      offsets[i] += offsets[i - 1];
+    }
+    for (auto const& tag : tags)
+    {
+      radixScratch[offsets[(tag.key >> shift) & (RADIX_BUCKETS - 1)]++] = tag;
+    }
+    tags.swap(radixScratch);
+  }
+}
 
-  switch (objectType) {
+static void bucketRenderTag(BucketTag const& thisTag, const glm::mat4& viewMatrix)
+{
+  switch (thisTag.objectType) {
     using enum RENDER_TYPE;
-    using enum EFFECT_GROUP;
     case RENDER_EFFECT:
-      switch (((EFFECT*)pObject)->group)
-      {
-        case EXPLOSION:
-        case CONSTRUCTION:
-        case SMOKE:
-        case FIREWORK:
-          // Use calculated Z
-          break;
-
-        case WAYPOINT:
-          pie = ((EFFECT*)pObject)->imd.get();
-          z = INT32_MAX - pie->texpage;
-          break;
-
-        default:
-          z = INT32_MAX - 42;
-          break;
-      }
+      renderEffect((EFFECT*)thisTag.pObject, viewMatrix);
       break;
     case RENDER_DROID:
-      pie = BODY_IMD(((Droid *)pObject), 0);
-      z = INT32_MAX - pie->texpage;
+      displayComponentObject((Droid*)thisTag.pObject, viewMatrix);
       break;
     case RENDER_STRUCTURE:
-      pie = ((Structure*)pObject)->getDisplayData()->imd_shape.get();
-      z = INT32_MAX - pie->texpage;
+      renderStructure((Structure*)thisTag.pObject, viewMatrix);
       break;
     case RENDER_FEATURE:
-      pie = ((Feature*)pObject)->getDisplayData()->imd_shape.get();
-      z = INT32_MAX - pie->texpage;
+      renderFeature((Feature*)thisTag.pObject, viewMatrix);
       break;
-    case RENDER_DELIVPOINT:
-      pie = pAssemblyPointIMDs[((FlagPosition*)pObject)->
-              factoryType][((FlagPosition*)pObject)->factoryInc];
-      z = INT32_MAX - pie->texpage;
+    case RENDER_PROXMSG:
+      renderProximityMsg((PROXIMITY_DISPLAY*)thisTag.pObject, viewMatrix);
       break;
-    case RENDER_PARTICLE:
-      z = 0;
+    case RENDER_PROJECTILE:
+      renderProjectile((Projectile*)thisTag.pObject, viewMatrix);
       break;
-    default:
-      // Use calculated Z
+    case RENDER_DELIVPOINT:
+      renderDeliveryPoint((FlagPosition*)thisTag.pObject, false, viewMatrix);
       break;
   }
-
-	//put the object data into the tag
-  auto newTag = BUCKET_TAG{objectType, pObject, z};
-
-	//add tag to bucketArray
-	bucketArray.push_back(newTag);
 }
 
 /* render Objects in list */
 void bucketRenderCurrentList(const glm::mat4& viewMatrix)
 {
-  std::sort(bucketArray.begin(), bucketArray.end());
+  bucketProjectCandidates(viewMatrix);
+
+  // Group by texture page, then by mesh, to keep state changes down
+  std::stable_sort(opaqueQueue.begin(), opaqueQueue.end(), [](BucketTag const& a, BucketTag const& b) {
+    return a.key != b.key ? a.key < b.key : std::less<const iIMDShape*>()(a.pie, b.pie);
+  });
+  bucketRadixSort(transparentQueue);
 
-  for (auto& thisTag : bucketArray)
+  for (auto const& thisTag : opaqueQueue)
   {
-    switch (thisTag.objectType) {
-      using enum RENDER_TYPE;
-      case RENDER_PARTICLE:
-        ::renderParticle((Particle*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_EFFECT:
-        renderEffect((EFFECT*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_DROID:
-        displayComponentObject((Droid*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_STRUCTURE:
-        renderStructure((Structure*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_FEATURE:
-        renderFeature((Feature*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_PROXMSG:
-        renderProximityMsg((PROXIMITY_DISPLAY*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_PROJECTILE:
-        renderProjectile((Projectile*)thisTag.pObject, viewMatrix);
-        break;
-      case RENDER_DELIVPOINT:
-        renderDeliveryPoint((FlagPosition*)thisTag.pObject, false, viewMatrix);
-        break;
-    }
+    bucketRenderTag(thisTag, viewMatrix);
+  }
+  for (auto const& thisTag : transparentQueue)
+  {
+    bucketRenderTag(thisTag, viewMatrix);
   }
 
-	//reset the bucket array as we go
-	bucketArray.resize(0);
+	//reset the queues as we go
+  opaqueQueue.clear();
+  transparentQueue.clear();
 }
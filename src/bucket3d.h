@@ -25,12 +25,6 @@
 #include "console.h"
 
 
-static constexpr auto SCALE_DEPTH = FP12_MULTIPLIER * 7;
-static constexpr auto CLIP_LEFT = 0;
-static constexpr auto CLIP_TOP = 0;
-static const auto CLIP_RIGHT = pie_GetVideoBufferWidth();
-static const auto CLIP_BOTTOM = pie_GetVideoBufferHeight();
-
 enum class RENDER_TYPE
 {
 	RENDER_DROID,
@@ -39,21 +33,11 @@ enum class RENDER_TYPE
 	RENDER_PROXMSG,
 	RENDER_PROJECTILE,
 	RENDER_EFFECT,
-	RENDER_DELIVPOINT,
-	RENDER_PARTICLE
-};
-
-struct BUCKET_TAG
-{
-  BUCKET_TAG(RENDER_TYPE, void*, int);
-  bool operator<(BUCKET_TAG const& b) const;
-
-  RENDER_TYPE objectType; // type of object held
-  void* pObject; // pointer to the object
-  int actualZ;
+	RENDER_DELIVPOINT
 };
 
-/// Add an object to the current render list
+/// Add an object to the current render list. It is projected and
+/// clipped along with the rest of the list when the list is rendered.
 void bucketAddTypeToList(RENDER_TYPE objectType, void* object, glm::mat4 const& viewMatrix);
 
 void bucketRenderCurrentList(glm::mat4 const& viewMatrix);
@@ -31,93 +31,107 @@
 bool isHumanPlayer(unsigned);
 
 
-// If the path finding system is shutdown or not
-static volatile bool fpathQuit = false;
-
 /* Beware: Enabling this will cause significant slow-down. */
 #undef DEBUG_MAP
 
-// threading stuff
-static WZ_THREAD* fpathThread = nullptr;
-static WZ_MUTEX* fpathMutex = nullptr;
-static WZ_SEMAPHORE* fpathSemaphore = nullptr;
 using packagedPathJob = wz::packaged_task<PathResult()>;
-static std::list<packagedPathJob> pathJobs;
-static std::unordered_map<uint32_t, wz::future<PathResult>> pathResults;
 
-static bool waitingForResult = false;
-static uint32_t waitingForResultId;
-static WZ_SEMAPHORE* waitingForResultSemaphore = nullptr;
+/// Everything the path finding module keeps for one game: the worker thread, its job queue and the results.
+struct FpathContext
+{
+	volatile bool quit = false;  ///< If the path finding system is shutdown or not
+	WZ_THREAD *thread = nullptr;
+	WZ_MUTEX *mutex = nullptr;
+	WZ_SEMAPHORE *semaphore = nullptr;
+	std::list<packagedPathJob> pathJobs;
+	std::unordered_map<uint32_t, wz::future<PathResult>> pathResults;
+	std::vector<PathContext> astarContexts;  ///< A* explorations kept for reuse. Only used by the worker thread.
+	PathBlockingMaps blockingMaps;           ///< Blocking maps of the current tick. Only used by the main thread.
+
+	bool waitingForResult = false;
+	uint32_t waitingForResultId = 0;
+	WZ_SEMAPHORE *waitingForResultSemaphore = nullptr;
+};
 
-static PathResult fpathExecute(const PathJob& psJob);
+static FpathContext defaultFpathContext;
+static FpathContext *fpathContext = &defaultFpathContext;  ///< The context the fpath* functions work on.
+
+static PathResult fpathExecute(FpathContext& ctx, PathJob& job);
 
 
 /// This runs in a separate thread
-static int fpathThreadFunc(void*)
+static int fpathThreadFunc(void *data)
 {
-	wzMutexLock(fpathMutex);
+	FpathContext &ctx = *static_cast<FpathContext *>(data);
+	wzMutexLock(ctx.mutex);
 
-	while (!fpathQuit)
+	while (!ctx.quit)
 	{
-		if (pathJobs.empty()) {
-			ASSERT(!waitingForResult, "Waiting for a result (id %u) that doesn't exist.", waitingForResultId);
-			wzMutexUnlock(fpathMutex);
-			wzSemaphoreWait(fpathSemaphore); // Go to sleep until needed.
-			wzMutexLock(fpathMutex);
+		if (ctx.pathJobs.empty()) {
+			ASSERT(!ctx.waitingForResult, "Waiting for a result (id %u) that doesn't exist.", ctx.waitingForResultId);
+			wzMutexUnlock(ctx.mutex);
+			wzSemaphoreWait(ctx.semaphore); // Go to sleep until needed.
+			wzMutexLock(ctx.mutex);
 			continue;
 		}
 
 		// Copy the first job from the queue.
-		packagedPathJob job = std::move(pathJobs.front());
-		pathJobs.pop_front();
+		packagedPathJob job = std::move(ctx.pathJobs.front());
+		ctx.pathJobs.pop_front();
 
-		wzMutexUnlock(fpathMutex);
+		wzMutexUnlock(ctx.mutex);
 		job();
-		wzMutexLock(fpathMutex);
+		wzMutexLock(ctx.mutex);
 
-		waitingForResult = false;
-		objTrace(waitingForResultId, "These are the droids you are looking for.");
-		wzSemaphorePost(waitingForResultSemaphore);
+		ctx.waitingForResult = false;
+		objTrace(ctx.waitingForResultId, "These are the droids you are looking for.");
+		wzSemaphorePost(ctx.waitingForResultSemaphore);
 	}
-	wzMutexUnlock(fpathMutex);
+	wzMutexUnlock(ctx.mutex);
 	return 0;
 }
 
 // initialise the findpath module
 bool fpathInitialise()
 {
+	FpathContext &ctx = *fpathContext;
+
 	// The path system is up
-	fpathQuit = false;
-  if (fpathThread != nullptr) return true;
-
-  fpathMutex = wzMutexCreate();
-  fpathSemaphore = wzSemaphoreCreate(0);
-  waitingForResultSemaphore = wzSemaphoreCreate(0);
-  fpathThread = wzThreadCreate(fpathThreadFunc, nullptr);
-  wzThreadStart(fpathThread);
+	ctx.quit = false;
+  if (ctx.thread != nullptr) return true;
+
+  ctx.mutex = wzMutexCreate();
+  ctx.semaphore = wzSemaphoreCreate(0);
+  ctx.waitingForResultSemaphore = wzSemaphoreCreate(0);
+  ctx.thread = wzThreadCreate(fpathThreadFunc, &ctx);
+  wzThreadStart(ctx.thread);
   return true;
 }
 
 void fpathShutdown()
 {
-	if (!fpathThread) {
-    fpathHardTableReset();
+	FpathContext &ctx = *fpathContext;
+
+	if (!ctx.thread) {
+    ctx.astarContexts.clear();
+    fpathHardTableReset(ctx.blockingMaps);
     return;
   }
 
   // Signal the path finding thread to quit
-  fpathQuit = true;
-  wzSemaphorePost(fpathSemaphore); // Wake up thread.
-
-  wzThreadJoin(fpathThread);
-  fpathThread = nullptr;
-  wzMutexDestroy(fpathMutex);
-  fpathMutex = nullptr;
-  wzSemaphoreDestroy(fpathSemaphore);
-  fpathSemaphore = nullptr;
-  wzSemaphoreDestroy(waitingForResultSemaphore);
-  waitingForResultSemaphore = nullptr;
-	fpathHardTableReset();
+  ctx.quit = true;
+  wzSemaphorePost(ctx.semaphore); // Wake up thread.
+
+  wzThreadJoin(ctx.thread);
+  ctx.thread = nullptr;
+  wzMutexDestroy(ctx.mutex);
+  ctx.mutex = nullptr;
+  wzSemaphoreDestroy(ctx.semaphore);
+  ctx.semaphore = nullptr;
+  wzSemaphoreDestroy(ctx.waitingForResultSemaphore);
+  ctx.waitingForResultSemaphore = nullptr;
+  ctx.astarContexts.clear();
+	fpathHardTableReset(ctx.blockingMaps);
 }
 
 bool fpathIsEquivalentBlocking(PathBlockingType first, PathBlockingType second)
@@ -247,7 +261,7 @@ void fpathSetMove(Movement* psMoveCntl, Vector2i targetLocation)
 
 void fpathRemoveDroidData(unsigned id)
 {
-	pathResults.erase(id);
+	fpathContext->pathResults.erase(id);
 }
 
 static FPATH_RESULT fpathRoute(Movement* psMove, unsigned id, int startX, 
@@ -283,8 +297,8 @@ static FPATH_RESULT fpathRoute(Movement* psMove, unsigned id, int startX,
 	{
 		objTrace(id, "Checking if we have a path yet");
 
-		auto const& I = pathResults.find(id);
-		ASSERT(I != pathResults.end(), "Missing path result promise");
+		auto const& I = fpathContext->pathResults.find(id);
+		ASSERT(I != fpathContext->pathResults.end(), "Missing path result promise");
 		PathResult result = I->second.get();
 		ASSERT(result.retval != OK || !result.sMove->path.empty(),
            "Ok result but no path in list");
@@ -302,7 +316,7 @@ static FPATH_RESULT fpathRoute(Movement* psMove, unsigned id, int startX,
            "Ok result but no path after copy");
 
 		// remove it from the result list
-		pathResults.erase(id);
+		fpathContext->pathResults.erase(id);
 
 		objTrace(id, "Got a path to (%d, %d)! Length=%d Retval=%d", 
              psMove->destination.x, psMove->destination.y,
@@ -329,28 +343,28 @@ static FPATH_RESULT fpathRoute(Movement* psMove, unsigned id, int startX,
     job.moveType = moveType;
     job.acceptNearest = acceptNearest;
     job.deleted = false;
-    fpathSetBlockingMap(job);
+    fpathSetBlockingMap(fpathContext->blockingMaps, job);
 
     debug(LOG_NEVER, "starting new job for droid %d 0x%x", id, id);
     // Clear any results or jobs waiting already. It is a vital assumption that there is only one
     // job or result for each droid in the system at any time.
     fpathRemoveDroidData(id);
 
-    packagedPathJob task([job]() {
-      return fpathExecute(job);
+    packagedPathJob task([job, ctx = fpathContext]() mutable {
+      return fpathExecute(*ctx, job);
     });
 
-    pathResults[id] = task.get_future();
+    fpathContext->pathResults[id] = task.get_future();
 
     // add to end of list
-    wzMutexLock(fpathMutex);
-    bool isFirstJob = pathJobs.empty();
-    pathJobs.push_back(std::move(task));
-    wzMutexUnlock(fpathMutex);
+    wzMutexLock(fpathContext->mutex);
+    bool isFirstJob = fpathContext->pathJobs.empty();
+    fpathContext->pathJobs.push_back(std::move(task));
+    wzMutexUnlock(fpathContext->mutex);
 
     if (isFirstJob) {
       // wake up processing thread
-      wzSemaphorePost(fpathSemaphore);
+      wzSemaphorePost(fpathContext->semaphore);
     }
 
     objTrace(id, "Queued up a path-finding request to (%d, %d), at least %d items earlier in queue",
@@ -434,13 +448,13 @@ PathResult::PathResult(unsigned id, FPATH_RESULT result, Vector2i originalDest)
 }
 
 /// Run only from path thread
-PathResult fpathExecute(PathJob& job)
+static PathResult fpathExecute(FpathContext& ctx, PathJob& job)
 {
   using enum ASTAR_RESULT;
 	auto result = PathResult{job.droidID, FPATH_RESULT::FAILED,
                            Vector2i(job.destination.x, job.destination.y)};
 
-	auto retval = fpathAStarRoute(*result.sMove, job);
+	auto retval = fpathAStarRoute(ctx.astarContexts, *result.sMove, job);
 	ASSERT(retval != OK || !result.sMove->path.empty(),
          "Ok result but no path in result");
   
@@ -481,10 +495,10 @@ PathResult fpathExecute(PathJob& job)
 static size_t fpathJobQueueLength()
 {
 	size_t count = 0;
-	wzMutexLock(fpathMutex);
-	count = pathJobs.size();
+	wzMutexLock(fpathContext->mutex);
+	count = fpathContext->pathJobs.size();
 	// O(N) function call for std::list. .empty() is faster, but this function isn't used except in tests.
-	wzMutexUnlock(fpathMutex);
+	wzMutexUnlock(fpathContext->mutex);
 	return count;
 }
 
@@ -492,10 +506,10 @@ static size_t fpathJobQueueLength()
 static size_t fpathResultQueueLength()
 {
 	size_t count = 0;
-	wzMutexLock(fpathMutex);
-	count = pathResults.size();
+	wzMutexLock(fpathContext->mutex);
+	count = fpathContext->pathResults.size();
 	// O(N) function call for std::list. .empty() is faster, but this function isn't used except in tests.
-	wzMutexUnlock(fpathMutex);
+	wzMutexUnlock(fpathContext->mutex);
 	return count;
 }
 
@@ -519,11 +533,11 @@ void fpathTest(int x, int y, int x2, int y2)
 	(void)fpathJobQueueLength();
 
 	/* Check initial state */
-	assert(fpathThread != nullptr);
-	assert(fpathMutex != nullptr);
-	assert(fpathSemaphore != nullptr);
-	assert(pathJobs.empty());
-	assert(pathResults.empty());
+	assert(fpathContext->thread != nullptr);
+	assert(fpathContext->mutex != nullptr);
+	assert(fpathContext->semaphore != nullptr);
+	assert(fpathContext->pathJobs.empty());
+	assert(fpathContext->pathResults.empty());
 	fpathRemoveDroidData(0); // should not crash
 
 	/* This should not leak memory */
@@ -599,7 +613,7 @@ void fpathTest(int x, int y, int x2, int y2)
 	{
 		fpathRemoveDroidData(i);
 	}
-	assert(pathResults.empty());
+	assert(fpathContext->pathResults.empty());
 	(void)r; // squelch unused-but-set warning.
 }
 
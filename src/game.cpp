@@ -6971,8 +6971,16 @@ static void writeScriptState(const char* pFileName)
 	sstrcpy(jsFilename, pFileName);
 	ext = strrchr(jsFilename, '/');
 	*ext = '\0';
-	strcat(jsFilename, "/scriptstate.json");
+	strcat(jsFilename, "/scriptstate.cbor");
 	saveScriptStates(jsFilename);
+
+	// readable copy for debugging, never loaded while the binary one exists
+	if (debugPartEnabled(LOG_SAVE))
+	{
+		*strrchr(jsFilename, '.') = '\0';
+		strcat(jsFilename, ".json");
+		saveScriptStates(jsFilename);
+	}
 }
 
 // load the script state given a .gam name
@@ -6984,7 +6992,13 @@ void loadScriptState(char* pFileName)
 
 	// The below belongs to the new javascript stuff
 	sstrcpy(jsFilename, pFileName);
-	strcat(jsFilename, "/scriptstate.json");
+	strcat(jsFilename, "/scriptstate.cbor");
+	if (!PHYSFS_exists(jsFilename))
+	{
+		// saves from before script states were binary
+		*strrchr(jsFilename, '.') = '\0';
+		strcat(jsFilename, ".json");
+	}
 	loadScriptStates(jsFilename);
 
 	// change the file extension
@@ -24,6 +24,7 @@
  */
 
 #include "lib/framework/wzapp.h"
+#include "lib/gamelib/gtime.h"
 #include "lib/ivis_opengl/piestate.h"
 #include "lib/ivis_opengl/piemode.h"
 #include "lib/sound/cdaudio.h"
@@ -554,6 +555,50 @@ void setMaxFastForwardTicks(optional<std::size_t> value, bool fixedToNormalTickR
 	fastForwardTicksFixedToNormalTickRate = fixedToNormalTickRate;
 }
 
+/// How often (in gameTime) headless replay playback prints the game state CRC.
+#define REPLAY_VERIFY_CRC_INTERVAL (10 * GAME_TICKS_PER_SEC)
+
+/// Headless replay playback: print our game state CRC once per REPLAY_VERIFY_CRC_INTERVAL.
+/// Called after every game state update, since a single gameLoop() call may fast-forward through many intervals.
+static void headlessReplayTick()
+{
+	static uint32_t nextCrcOutputTime = 0;
+	GameTimeSyncStats const &stats = gameTimeGetSyncStats();
+
+	if (stats.lastCheckTime >= nextCrcOutputTime)
+	{
+		fprintf(stdout, "Replay CRC [gameTime: %" PRIu32 "]: 0x%04" PRIX32 "\n", stats.lastCheckTime, stats.lastCheckCrc);
+		nextCrcOutputTime = stats.lastCheckTime - stats.lastCheckTime % REPLAY_VERIFY_CRC_INTERVAL + REPLAY_VERIFY_CRC_INTERVAL;
+	}
+}
+
+/// Headless replay playback: once the replay has run out of GAME_GAME_TIME messages, print the sync results
+/// and end-of-game stats and quit. Exits with status 1 if any CRC recorded in the replay didn't match ours.
+static void headlessReplayUpdate()
+{
+	static bool finished = false;
+	if (finished)
+	{
+		return;  // Waiting for wzQuit() to take effect.
+	}
+	GameTimeSyncStats const &stats = gameTimeGetSyncStats();
+
+	if (checkPlayerGameTime(NET_ALL_PLAYERS))
+	{
+		return;  // Still more of the replay to play back.
+	}
+
+	fprintf(stdout, "Replay finished [gameTime: %" PRIu32 "]: %" PRIu32 " CRCs checked, %" PRIu32 " mismatched", gameTime, stats.numChecked, stats.numMismatches);
+	if (stats.numMismatches > 0)
+	{
+		fprintf(stdout, " (first at gameTime: %" PRIu32 ")", stats.firstMismatchTime);
+	}
+	fprintf(stdout, "\n");
+	stdOutGameSummary(0);
+	finished = true;
+	wzQuit((stats.numMismatches > 0) ? 1 : 0);
+}
+
 /* The main game loop */
 GAME_CODE gameLoop()
 {
@@ -570,6 +615,7 @@ GAME_CODE gameLoop()
 
 	std::size_t numRegularUpdatesTicks = 0;
 	std::size_t numFastForwardTicks = 0;
+	const bool headlessReplay = headlessGameMode() && NETisReplay();
 	gameTimeUpdateBegin();
 	while (true)
 	{
@@ -581,9 +627,10 @@ GAME_CODE gameLoop()
 		bool multiplayerHostDisconnected = bMultiPlayer && !NetPlay.isHostAlive && NetPlay.bComms && !NetPlay.isHost;
 		// do not fast-forward after the host has disconnected
 		bool canFastForwardGameTime =
-			selectedPlayerIsSpectator // current player must be a spectator
-			&& !NetPlay.isHost // AND NOT THE HOST (!)
-			&& !multiplayerHostDisconnected // and the multiplayer host must not be disconnected ("host quit")
+			(headlessReplay // headless replay playback always fast-forwards, whoever the replay was recorded by
+			 || (selectedPlayerIsSpectator // current player must be a spectator
+				 && !NetPlay.isHost // AND NOT THE HOST (!)
+				 && !multiplayerHostDisconnected)) // and the multiplayer host must not be disconnected ("host quit")
 			&& numFastForwardTicks < maxFastForwardTicks
 			// and the number of forced updates this call of gameLoop must not exceed the max allowed
 			&& checkPlayerGameTime(NET_ALL_PLAYERS);
@@ -618,6 +665,11 @@ GAME_CODE gameLoop()
 		syncDebug("End game state update, gameTime = %d", gameTime);
 		unsigned after = wzGetTicks();
 
+		if (headlessReplay)
+		{
+			headlessReplayTick();
+		}
+
 		renderBudget -= (after - before) * renderFraction.n;
 		renderBudget = std::max(renderBudget, (-updateFraction * 500).floor());
 		previousUpdateWasRender = false;
@@ -645,6 +697,10 @@ GAME_CODE gameLoop()
 		// Output occasional stats to stdout
 		stdOutGameSummary();
 	}
+	else if (headlessReplay)
+	{
+		headlessReplayUpdate();
+	}
 
 	return renderReturn;
 }
@@ -59,6 +59,7 @@
 #include "lib/framework/wztime.h"
 #include "lib/exceptionhandler/exceptionhandler.h"
 #include "lib/exceptionhandler/dumpinfo.h"
+#include "lib/gamelib/gtime.h"
 
 #include "lib/ivis_opengl/pieblitfunc.h"
 #include "lib/ivis_opengl/piestate.h"
@@ -94,6 +95,7 @@
 #include "random.h"
 #include "urlrequest.h"
 #include <ctime>
+#include <limits>
 #include <LaunchInfo.h>
 #include <sodium.h>
 #include "updatemanager.h"
@@ -1037,8 +1039,17 @@ static void startGameLoop()
 	setMaxFastForwardTicks(WZ_DEFAULT_MAX_FASTFORWARD_TICKS, true); // default value / spectator "catch-up" behavior
 	if (NETisReplay())
 	{
-		// for replays, ensure we don't start off fast-forwarding
-		setMaxFastForwardTicks(0, true);
+		if (headlessGameMode())
+		{
+			// headless replay playback is for verification, so run the simulation as fast as possible
+			gameTimeSetMod(Rational(500));
+			setMaxFastForwardTicks(std::numeric_limits<std::size_t>::max(), false);
+		}
+		else
+		{
+			// for replays, ensure we don't start off fast-forwarding
+			setMaxFastForwardTicks(0, true);
+		}
 	}
 }
 
@@ -1820,6 +1831,9 @@ int realmain(int argc, char* argv[])
 	// Save new (commandline) settings
 	saveConfig();
 
+	// Autogames are how AI performance gets measured, so have them write out the scripts' call stack profiles
+	jsSetStackProfiling(autogame_enabled());
+
 	// Print out some initial information if in headless mode
 	if (headlessGameMode())
 	{
@@ -36,6 +36,9 @@ static constexpr auto OBJ_ID_INIT = 20000;
 unsigned unsynchObjID;
 unsigned synchObjID;
 
+/// Bumped whenever an object is added to or taken out of one of the object lists
+static unsigned objListGeneration = 0;
+
 /* Forward function declarations */
 #ifdef DEBUG
 static void objListIntegCheck();
@@ -102,6 +105,7 @@ static bool checkReferences(BaseObject const* psVictim)
 /* General housekeeping for the object system */
 void objmemUpdate()
 {
+	++objListGeneration;
   BaseObject *psCurr, *psNext, *psPrev;
 
 #ifdef DEBUG
@@ -135,6 +139,11 @@ void objmemUpdate()
 	}
 }
 
+unsigned objmemListGeneration()
+{
+	return objListGeneration;
+}
+
 unsigned generateNewObjectId()
 {
 	// Generate even ID for unsynchronized objects. This is needed for debug objects, templates and other border lines cases that should preferably be removed one day.
@@ -314,6 +323,7 @@ static inline void releaseAllObjectsInList(OBJECT* list[])
 /* add the droid to the Droid Lists */
 void addDroid(Droid* psDroidToAdd)
 {
+	++objListGeneration;
   apsDroidLists[psDroidToAdd->playerManager->getPlayer()].push_back(*psDroidToAdd);
 
   psDroidToAdd->damageManager->setTimeOfDeath(0);
@@ -331,6 +341,7 @@ void addDroid(Droid* psDroidToAdd)
 /* Destroy a droid */
 void killDroid(Droid* psDel)
 {
+	++objListGeneration;
 	ASSERT(psDel->playerManager->getPlayer() < MAX_PLAYERS,
 	       "killUnit: invalid player for unit");
 
@@ -350,6 +361,7 @@ void killDroid(Droid* psDel)
 /* Remove all droids */
 void freeAllDroids()
 {
+	++objListGeneration;
   std::for_each(apsDroidLists.begin(), apsDroidLists.end(),
                 [](auto& list) {
     list.clear();
@@ -359,6 +371,7 @@ void freeAllDroids()
 /*Remove a single Droid from a list*/
 void removeDroid(Droid* psDroidToRemove)
 {
+	++objListGeneration;
 	ASSERT_OR_RETURN(, psDroidToRemove->playerManager->getPlayer() < MAX_PLAYERS, "Invalid player for unit");
   std::erase(apsDroidLists[psDroidToRemove->playerManager->getPlayer()], psDroidToRemove);
 
@@ -374,6 +387,7 @@ void removeDroid(Droid* psDroidToRemove)
 /*Removes all droids that may be stored in the mission lists*/
 void freeAllMissionDroids()
 {
+	++objListGeneration;
   std::for_each(mission.apsDroidLists.begin(),
                 mission.apsDroidLists.end(),
                 [](auto& list) {
@@ -384,6 +398,7 @@ void freeAllMissionDroids()
 /*Removes all droids that may be stored in the limbo lists*/
 void freeAllLimboDroids()
 {
+	++objListGeneration;
   std::for_each(apsLimboDroids.begin(),
                 apsLimboDroids.end(),
                 [](auto& list) {
@@ -394,6 +409,7 @@ void freeAllLimboDroids()
 /* add the structure to the Structure Lists */
 void addStructure(Structure* psStructToAdd)
 {
+	++objListGeneration;
   apsStructLists[psStructToAdd->playerManager->getPlayer()].push_back(std::make_unique<Structure>(*psStructToAdd));
 	if (psStructToAdd->getStats()->sensor_stats && psStructToAdd->getStats()->sensor_stats->location == LOC::TURRET) {
     apsSensorList.push_back(psStructToAdd);
@@ -407,6 +423,7 @@ void addStructure(Structure* psStructToAdd)
 /* Destroy a structure */
 void killStruct(Structure* psBuilding)
 {
+	++objListGeneration;
 	ASSERT(psBuilding->playerManager->getPlayer() < MAX_PLAYERS,
 	       "killStruct: invalid player for stucture");
 
@@ -454,6 +471,7 @@ void killStruct(Structure* psBuilding)
 /* Remove heapall structures */
 void freeAllStructs()
 {
+	++objListGeneration;
   std::for_each(apsStructLists.begin(), apsStructLists.end(),
                 [](auto& list) {
     list.clear();
@@ -463,6 +481,7 @@ void freeAllStructs()
 /*Remove a single Structure from a list*/
 void removeStructureFromList(Structure* psStructToRemove)
 {
+	++objListGeneration;
   auto player = psStructToRemove->playerManager->getPlayer();
 	ASSERT(player < MAX_PLAYERS, "removeStructureFromList: invalid player for structure");
 
@@ -480,6 +499,7 @@ void removeStructureFromList(Structure* psStructToRemove)
 /* add the feature to the Feature Lists */
 void addFeature(Feature* psFeatureToAdd)
 {
+	++objListGeneration;
   apsFeatureLists[0].push_back(psFeatureToAdd);
 	if (psFeatureToAdd->getStats()->subType == FEATURE_TYPE::OIL_RESOURCE) {
 		addObjectToFuncList(apsOilList, psFeatureToAdd, 0);
@@ -491,6 +511,7 @@ void addFeature(Feature* psFeatureToAdd)
 // it's a bit of a hack, but hey, it works
 void killFeature(Feature* psDel)
 {
+	++objListGeneration;
 	psDel->playerManager->setPlayer(0);
 	destroyObject(apsFeatureLists, psDel);
 
@@ -502,6 +523,7 @@ void killFeature(Feature* psDel)
 /* Remove all features */
 void freeAllFeatures()
 {
+	++objListGeneration;
 	releaseAllObjectsInList(apsFeatureLists);
 }
 
@@ -51,6 +51,9 @@ void objmemShutdown();
 /* General housekeeping for the object system */
 void objmemUpdate();
 
+/// Changes whenever objects are added to or removed from the object lists, so cached lists can tell they are stale.
+unsigned objmemListGeneration();
+
 /// Generates a new, (hopefully) unique object id.
 unsigned generateNewObjectId();
 
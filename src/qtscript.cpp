@@ -39,6 +39,7 @@
 //__ to start receiving all events unfiltered.
 //__
 
+#include <algorithm>
 #include <sstream>
 #include <queue>
 
@@ -67,6 +68,14 @@ static constexpr auto ATTACK_THROTTLE = 1000;
 /// so until we have a queue system for events, delay triggering this way.
 static bool selectionChanged = false;
 
+/// whether newly loaded scripts sample their call stacks, see jsSetStackProfiling()
+static bool profileScriptStacks = false;
+
+void jsSetStackProfiling(bool enabled)
+{
+	profileScriptStacks = enabled;
+}
+
 void scripting_engine::GROUPMAP::saveLoadSetLastNewGroupId(int value)
 {
 	ASSERT_OR_RETURN(, value >= 0, "Invalid value: %d", value);
@@ -179,6 +188,7 @@ void scripting_engine::timerNode::swap(timerNode& _rhs)
 	std::swap(player, _rhs.player);
 	std::swap(calls, _rhs.calls);
 	std::swap(type, _rhs.type);
+	std::swap(seq, _rhs.seq);
 }
 
 scripting_engine::area_by_values_or_area_label_lookup::area_by_values_or_area_label_lookup()
@@ -200,6 +210,30 @@ scripting_engine::area_by_values_or_area_label_lookup::area_by_values_or_area_la
 #define MAX_US 20000
 #define HALF_MAX_US 10000
 
+/// Most queue()d calls one host AI instance may run per tick. The rest wait for the following ticks. This counts calls
+/// rather than measuring time, so that runs are repeatable. Scripts that run on every client (rules, campaign) are not
+/// capped, so their queued calls keep running when they were due.
+#define MAX_QUEUED_CALLS_PER_TICK 16
+
+/// Offset, in whole ticks below the timer's period, to the first run of a repeating host AI timer. Derived only from
+/// what the script asked for, so a save reloads with the same phase, while the timers of several AIs set up together
+/// at game start (typically all with the same period) end up on different ticks rather than all firing at once.
+static int timerPhase(const std::string& timerName, unsigned player, int milliseconds)
+{
+	int periodTicks = milliseconds / GAME_TICKS_PER_UPDATE;
+	if (periodTicks < 2)
+	{
+		return 0;
+	}
+	uint32_t hash = 2166136261u;  // FNV-1a
+	for (char c : timerName)
+	{
+		hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+	}
+	hash = (hash ^ player) * 16777619u;
+	return static_cast<int>(hash % static_cast<uint32_t>(periodTicks)) * GAME_TICKS_PER_UPDATE;
+}
+
 
 uniqueTimerID scripting_engine::getNextAvailableTimerID()
 {
@@ -225,8 +259,15 @@ uniqueTimerID scripting_engine::setTimer(wzapi::scripting_instance* caller, cons
 	}
 	node->type = type;
 	node->timerID = newTimerID;
+	node->seq = nextTimerSeq++;
+	if (type == TIMER_REPEAT && caller != nullptr && caller->isHostAI())
+	{
+		// Only host AIs, which run on the host alone. Rules and campaign scripts keep their timers where they were.
+		node->frameTime += timerPhase(timerName, player, milliseconds);
+	}
 	auto inserted_iter = timers.emplace(timers.end(), std::move(node));
 	timerIDMap[newTimerID] = inserted_iter;
+	scheduleTimer(*inserted_iter);
 	return newTimerID;
 }
 
@@ -235,8 +276,40 @@ void scripting_engine::addTimerNode(std::shared_ptr<scripting_engine::timerNode>
 {
 	ASSERT(timerIDMap.count(node->timerID) == 0, "Duplicate timerID found: %s",
 	       WzString::number(node->timerID).toUtf8().c_str());
+	node->seq = nextTimerSeq++;
 	auto inserted_iter = timers.emplace(timers.end(), std::move(node));
 	timerIDMap[(*inserted_iter)->timerID] = inserted_iter;
+	if ((*inserted_iter)->type == TIMER_ONESHOT_DONE)
+	{
+		oneShotDoneTimers.push_back((*inserted_iter)->timerID);
+	}
+	else
+	{
+		scheduleTimer(*inserted_iter);
+	}
+}
+
+// Puts the timer in the wheel bucket of the game tick it's next due.
+void scripting_engine::scheduleTimer(const std::shared_ptr<timerNode>& node)
+{
+	// Overdue timers go in the first bucket the next update looks at, rather than waiting for the wheel to come round.
+	uint32_t dueTime = std::max<uint32_t>(static_cast<unsigned>(node->frameTime), timerWheelTime);
+	size_t slot = dueTime / GAME_TICKS_PER_UPDATE % TIMER_WHEEL_SLOTS;
+	timerWheel[slot].push_back(node);
+}
+
+void scripting_engine::clearTimers()
+{
+	timers.clear();
+	lastTimerID = 0;
+	timerIDMap.clear();
+	for (auto& bucket : timerWheel)
+	{
+		bucket.clear();
+	}
+	timerWheelTime = 0;
+	nextTimerSeq = 0;
+	oneShotDoneTimers.clear();
 }
 
 /// Scripting engine (what others call the scripting context, but QtScript's nomenclature is different).
@@ -431,13 +504,15 @@ bool scripting_engine::shutdownScripts()
 			info << function << "\n";
 			instance->dumpScriptLog(info.str());
 		}
+		if (profileScriptStacks)
+		{
+			instance->writeProfiledStacks();
+		}
 		monitor->clear();
 		delete monitor;
 		unregisterFunctions(instance);
 	}
-	timers.clear();
-	lastTimerID = 0;
-	timerIDMap.clear();
+	clearTimers();
 	monitors.clear();
 	for (auto& script : scripts)
 	{
@@ -470,26 +545,76 @@ bool scripting_engine::updateScripts()
 		instance->updateGameTime(gameTime);
 	}
 	// Weed out dead timers
-	removeTimersIf([](const timerNode& node)
+	for (uniqueTimerID timerID : oneShotDoneTimers)
 	{
-		return (node.type == TIMER_ONESHOT_DONE);
-	});
+		auto it = timerIDMap.find(timerID);
+		if (it != timerIDMap.end() && (*it->second)->type == TIMER_ONESHOT_DONE)
+		{
+			removeTimer(timerID);
+		}
+	}
+	oneShotDoneTimers.clear();
 	// Check for timers, and run them if applicable.
-	// TODO - load balancing
 	std::vector<std::shared_ptr<timerNode>> runlist;
 	// make a new list here, since we might trample all over the timer list during execution
-	for (auto& node : timers)
-	{
-		if (node->frameTime <= gameTime)
+	// Only the buckets for the ticks since the last update can hold due timers. Each bucket also holds timers due a
+	// multiple of TIMER_WHEEL_SLOTS ticks later, which are left where they are.
+	uint32_t firstTick = timerWheelTime / GAME_TICKS_PER_UPDATE;
+	uint32_t lastTick = gameTime / GAME_TICKS_PER_UPDATE;
+	size_t numSlots = std::min<size_t>(lastTick - firstTick + 1, TIMER_WHEEL_SLOTS);
+	for (size_t n = 0; n < numSlots; ++n)
+	{
+		auto& bucket = timerWheel[(firstTick + n) % TIMER_WHEEL_SLOTS];
+		size_t numKept = 0;
+		for (size_t i = 0; i < bucket.size(); ++i)
 		{
-			node->frameTime = node->ms + gameTime; // update for next invokation
-			if (node->type == TIMER_ONESHOT_READY)
+			std::shared_ptr<timerNode> node = bucket[i].lock();
+			if (node == nullptr || node->type == TIMER_REMOVED)
+			{
+				continue;  // Timer was removed, drop it from the wheel.
+			}
+			if (static_cast<unsigned>(node->frameTime) <= gameTime)
+			{
+				runlist.push_back(std::move(node));
+				continue;
+			}
+			if (numKept != i)
 			{
-				node->type = TIMER_ONESHOT_DONE; // unless there is none
+				bucket[numKept] = std::move(bucket[i]);
 			}
-			node->calls++;
-			runlist.push_back(node);
+			++numKept;
 		}
+		bucket.resize(numKept);
+	}
+	timerWheelTime = gameTime;
+	// Run in the order the timers were added, same as when scanning the whole list.
+	std::sort(runlist.begin(), runlist.end(), [](std::shared_ptr<timerNode> const& a, std::shared_ptr<timerNode> const& b) {
+		return a->seq < b->seq;
+	});
+	// Queued calls are the lowest priority, so if a host AI has too many due now, leave the rest for later ticks.
+	std::unordered_map<wzapi::scripting_instance*, unsigned> queuedCallsRun;
+	runlist.erase(std::remove_if(runlist.begin(), runlist.end(), [this, &queuedCallsRun](std::shared_ptr<timerNode> const& node) {
+		if (node->type != TIMER_ONESHOT_READY || node->instance == nullptr || !node->instance->isHostAI()
+			|| ++queuedCallsRun[node->instance] <= MAX_QUEUED_CALLS_PER_TICK)
+		{
+			return false;
+		}
+		scheduleTimer(node);  // Still due, so goes in the bucket the next update looks at first.
+		return true;
+	}), runlist.end());
+	for (auto& node : runlist)
+	{
+		node->frameTime = node->ms + gameTime; // update for next invokation
+		if (node->type == TIMER_ONESHOT_READY)
+		{
+			node->type = TIMER_ONESHOT_DONE; // unless there is none
+			oneShotDoneTimers.push_back(node->timerID);
+		}
+		else
+		{
+			scheduleTimer(node);
+		}
+		node->calls++;
 	}
 
 	for (auto& node : runlist)
@@ -689,6 +814,7 @@ wzapi::scripting_instance* scripting_engine::loadPlayerScript(const WzString& pa
 
 	// Register script
 	scripts.push_back(pNewInstance);
+	pNewInstance->setStackProfiling(profileScriptStacks);
 
 	auto* monitor = new MONITOR;
 	monitors[pNewInstance] = monitor;
@@ -703,6 +829,13 @@ bool loadGlobalScript(const WzString& path)
 	return loadPlayerScript(path, selectedPlayer, AIDifficulty::DISABLED);
 }
 
+/// Script states are saved as CBOR, with JSON text still read from older saves and written as a debug export
+static WzConfig::format scriptStatesFormat(const char* filename)
+{
+	size_t length = strlen(filename);
+	return (length >= 5 && strcmp(filename + length - 5, ".json") == 0) ? WzConfig::Json : WzConfig::Cbor;
+}
+
 bool saveScriptStates(const char* filename)
 {
 	return scripting_engine::instance().saveScriptStates(filename);
@@ -710,7 +843,7 @@ bool saveScriptStates(const char* filename)
 
 bool scripting_engine::saveScriptStates(const char* filename)
 {
-	WzConfig ini(filename, WzConfig::ReadAndWrite);
+	WzConfig ini(filename, WzConfig::ReadAndWrite, scriptStatesFormat(filename));
 	for (int i = 0; i < scripts.size(); ++i)
 	{
 		wzapi::scripting_instance* instance = scripts.at(i);
@@ -781,7 +914,7 @@ bool loadScriptStates(const char* filename)
 bool scripting_engine::loadScriptStates(const char* filename)
 {
 	uniqueTimerID maxRestoredTimerID = 0;
-	WzConfig ini(filename, WzConfig::ReadOnly);
+	WzConfig ini(filename, WzConfig::ReadOnly, scriptStatesFormat(filename));
 	std::vector<WzString> list = ini.childGroups();
 	debug(LOG_SAVE, "Loading script states for %zu script contexts", scripts.size());
 	for (size_t i = 0; i < list.size(); ++i)
@@ -20,6 +20,7 @@
 #ifndef __INCLUDED_QTSCRIPT_H__
 #define __INCLUDED_QTSCRIPT_H__
 
+#include <array>
 #include <list>
 #include <map>
 #include <memory>
@@ -106,7 +107,8 @@ bool loadGlobalScript(const WzString& path);
 wzapi::scripting_instance* loadPlayerScript(const WzString& path, unsigned player, AIDifficulty difficulty);
 
 // Set/write variables in the script's global context, run after loading script,
-// but before triggering any events.
+// but before triggering any events. Files ending in ".json" are JSON text, anything
+// else uses the binary (CBOR) encoding.
 bool loadScriptStates(const char* filename);
 bool saveScriptStates(const char* filename);
 
@@ -159,6 +161,9 @@ bool triggerEventAllianceBroken(unsigned from, unsigned to);
 
 void jsDebugSelected(const BaseObject * psObj);
 void jsDebugMessageUpdate();
+/// Record sampled call stacks of scripts loaded from now on, written to logs/<script>.<player>.folded
+/// on shutdown for flamegraph tools. Enabled at startup for autogames.
+void jsSetStackProfiling(bool enabled);
 
 //
 
@@ -259,6 +264,7 @@ public:
 		unsigned player;
 		int calls;
 		timerType type;
+		uint32_t seq = 0;  ///< Position in `timers`, so timers due on the same tick run in the order they were added.
 
 		timerNode() : instance(nullptr), baseobjtype(OBJ_NUM_TYPES), additionalTimerFuncParam(nullptr)
 		{
@@ -299,6 +305,17 @@ private:
 	uniqueTimerID lastTimerID = 0;
 	std::unordered_map<uniqueTimerID, std::list<std::shared_ptr<timerNode>>::iterator> timerIDMap;
 	// a map from uniqueTimerID -> entry in the timers list
+
+	/// Hashed timing wheel over `timers`, bucketed by the game tick each timer is next due, so that a tick only looks at
+	/// the timers in its own bucket. Holds weak references, so erasing a timer from `timers` is enough to cancel it.
+	static constexpr size_t TIMER_WHEEL_SLOTS = 256;
+	std::array<std::vector<std::weak_ptr<timerNode>>, TIMER_WHEEL_SLOTS> timerWheel;
+	uint32_t timerWheelTime = 0;  ///< gameTime the wheel was last advanced to.
+	uint32_t nextTimerSeq = 0;
+	std::vector<uniqueTimerID> oneShotDoneTimers;  ///< Fired one-shot timers, to be removed at the start of the next update.
+
+	void scheduleTimer(const std::shared_ptr<timerNode>& node);
+	void clearTimers();
 private:
 	scripting_engine() = default;
 
@@ -27,6 +27,7 @@
 #include "lib/framework/wzpaths.h"
 #include "lib/framework/fixedpoint.h"
 #include "lib/framework/string_ext.h"
+#include "lib/framework/physfs_ext.h"
 #include "lib/sound/audio.h"
 #include "lib/sound/cdaudio.h"
 #include "lib/netplay/netplay.h"
@@ -73,12 +74,15 @@
 #include "wzapi.h"
 #include "qtscript.h"
 #include "data.h"
+#include "version.h"
 
 
 #include <unordered_set>
 #include "lib/framework/file.h"
 #include <unordered_map>
 #include <limits>
+#include <array>
+#include <chrono>
 
 #if !defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8
 #pragma GCC diagnostic push
@@ -145,6 +149,22 @@ bool QuickJS_EnumerateObjectProperties(JSContext* ctx, JSValue obj,
 class quickjs_scripting_instance;
 static std::map<JSContext*, quickjs_scripting_instance*> engineToInstanceMap;
 
+static int QuickJS_ProfileInterruptHandler(JSRuntime* rt, void* opaque); // forward-declare
+
+/// Class of converted game objects, which carry a LazyObjectSnapshot
+static JSClassID lazyObjectClassId = 0;
+static void js_lazyObject_finalizer(JSRuntime* rt, JSValue val); // forward-declare
+
+/// Object properties created on first read, see lazyObjectProperties
+enum LAZY_PROPERTY
+{
+	LAZY_NAME,
+	LAZY_BODY,
+	LAZY_PROPULSION,
+	LAZY_WEAPONS,
+	LAZY_COUNT
+};
+
 static void QJSRuntimeFree_LeakHandler_Error(const char* msg)
 {
 	debug(LOG_ERROR, "QuickJS FreeRuntime leak: %s", msg);
@@ -162,6 +182,18 @@ public:
 		ASSERT(ctx != nullptr, "JS_NewContext failed?");
 		global_obj = JS_GetGlobalObject(ctx);
 
+		JS_NewClassID(&lazyObjectClassId);
+		if (!JS_IsRegisteredClass(rt, lazyObjectClassId))
+		{
+			JSClassDef lazyObjectClass = {};
+			lazyObjectClass.class_name = "Object";
+			lazyObjectClass.finalizer = js_lazyObject_finalizer;
+			JS_NewClass(rt, lazyObjectClassId, &lazyObjectClass);
+		}
+		JSValue objectCtor = JS_GetPropertyStr(ctx, global_obj, "Object");
+		JS_SetClassProto(ctx, lazyObjectClassId, JS_GetPropertyStr(ctx, objectCtor, "prototype"));
+		JS_FreeValue(ctx, objectCtor);
+
 		engineToInstanceMap.insert(std::pair<JSContext*, quickjs_scripting_instance*>(ctx, this));
 	}
 
@@ -175,6 +207,17 @@ public:
 			compiledScriptObj = JS_UNINITIALIZED;
 		}
 
+		for (auto& accessor : lazyAccessors)
+		{
+			if (accessor.atom != JS_ATOM_NULL)
+			{
+				JS_FreeAtom(ctx, accessor.atom);
+				JS_FreeValue(ctx, accessor.getter);
+				JS_FreeValue(ctx, accessor.setter);
+				accessor = LazyAccessor();
+			}
+		}
+
 		JS_FreeValue(ctx, global_obj);
 		ASSERT(ctx != nullptr, "context is null??");
 		if (ctx)
@@ -193,6 +236,43 @@ public:
 	bool loadScript(const WzString& path, unsigned player, int difficulty);
 	bool readyInstanceForExecution() override;
 
+	void setStackProfiling(bool enabled) override
+	{
+		isProfilingStacks = enabled;
+		JS_SetInterruptHandler(rt, enabled ? QuickJS_ProfileInterruptHandler : nullptr, enabled ? this : nullptr);
+	}
+
+	/// Charge the time since the previous sample to the current call stack. QuickJS calls the interrupt handler
+	/// every few thousand function calls and loop iterations, so this is called often while script code runs.
+	void sampleProfiledStack()
+	{
+		chargeProfiledTime(currentProfiledStack());
+	}
+
+	/// Call before running a script function, and afterwards with the function's name. The time since the last
+	/// sample is charged to the function then, as its frames have already gone from the stack.
+	void beginProfiledCall()
+	{
+		std::string stack = currentProfiledStack();
+		if (stack.empty())
+		{
+			lastProfileSample = std::chrono::steady_clock::now();
+		}
+		else
+		{
+			chargeProfiledTime(stack); // nested call, e.g. through profile()
+		}
+	}
+	void endProfiledCall(const std::string& function)
+	{
+		std::string stack = currentProfiledStack();
+		chargeProfiledTime(stack.empty() ? function : stack + ";" + function);
+	}
+	[[nodiscard]] bool profilingStacks() const { return isProfilingStacks; }
+
+	/// Give a converted object the not yet created accessor properties of its type (see lazyObjectProperties)
+	void defineLazyObjectProperties(JSValue value, OBJECT_TYPE type);
+
 private:
 	bool registerFunctions(const std::string& scriptName);
 
@@ -252,6 +332,30 @@ private:
 	JSValue global_obj;
 
 	JSValue compiledScriptObj = JS_UNINITIALIZED;
+
+	std::string currentProfiledStack()
+	{
+		char stack[1024];
+		size_t length = js_debugger_get_collapsed_stack(ctx, stack, sizeof(stack));
+		return std::string(stack, length);
+	}
+	void chargeProfiledTime(const std::string& stack)
+	{
+		auto now = std::chrono::steady_clock::now();
+		recordProfiledStack(stack, std::chrono::duration_cast<std::chrono::microseconds>(now - lastProfileSample).count());
+		lastProfileSample = now;
+	}
+
+	bool isProfilingStacks = false;
+	std::chrono::steady_clock::time_point lastProfileSample;
+	/// Property name and getter / setter functions of each lazily created object property, created on first use
+	struct LazyAccessor
+	{
+		JSAtom atom = JS_ATOM_NULL;
+		JSValue getter = JS_UNDEFINED;
+		JSValue setter = JS_UNDEFINED;
+	};
+	std::array<LazyAccessor, LAZY_COUNT> lazyAccessors;
 	std::string m_path;
 	/// Remember what names are used internally in the scripting engine, we don't want to save these to the savegame
 	std::unordered_set<std::string> internalNamespace;
@@ -706,6 +810,12 @@ JSValue mapJsonToQuickJSValue(JSContext* ctx, const nlohmann::json& instance, ui
 	return JS_UNDEFINED; // should never be reached
 }
 
+static int QuickJS_ProfileInterruptHandler(JSRuntime* rt, void* opaque)
+{
+	static_cast<quickjs_scripting_instance*>(opaque)->sampleProfiledStack();
+	return 0; // never interrupt the script
+}
+
 int JS_DeletePropertyStr(JSContext* ctx, JSValueConst this_obj,
                          const char* prop)
 {
@@ -782,6 +892,203 @@ JSValue convResearch(const ResearchStats* psResearch, JSContext* ctx, unsigned p
 	return value;
 }
 
+// MARK: Lazily created object properties
+//
+// Scripts enumerate many objects per call but typically read only a few fields of each, so the
+// fields that need strings or nested objects built (name, components, weapon list) start out as
+// enumerable accessor properties of the object itself. The inputs for them are copied into a
+// LazyObjectSnapshot owned by the object when it is converted, and on first read the getter builds
+// the value from that snapshot and replaces itself with an ordinary data property. So the value is
+// the one the object had when converted, however long the script keeps it, whether or not the game
+// object is still around. Being own enumerable properties, they are still seen by for..in,
+// Object.keys(), JSON.stringify(), spreading and the savegame serialisation, which all read them
+// through the getter.
+
+struct WeaponSummary
+{
+	bool aa = false;
+	bool ga = false;
+	bool indirect = false;
+	int range = -1;
+};
+
+static WeaponSummary droidWeaponSummary(const Droid* psDroid)
+{
+	WeaponSummary summary;
+	for (int i = 0; i < psDroid->numWeaps; i++)
+	{
+		if (psDroid->asWeaps[i].nStat)
+		{
+			WeaponStats* psWeap = &asWeaponStats[psDroid->asWeaps[i].nStat];
+			summary.aa = summary.aa || psWeap->surfaceToAir & SHOOT_IN_AIR;
+			summary.ga = summary.ga || psWeap->surfaceToAir & SHOOT_ON_GROUND;
+			summary.indirect = summary.indirect || psWeap->movementModel == MOVEMENT_MODEL::HOMING_DIRECT ||
+			                   psWeap->movementModel == MOVEMENT_MODEL::HOMING_INDIRECT;
+			summary.range = MAX(proj_GetLongRange(psWeap, psDroid->playerManager->getPlayer()), summary.range);
+		}
+	}
+	return summary;
+}
+
+static WeaponSummary structureWeaponSummary(const Structure* psStruct)
+{
+	WeaponSummary summary;
+	for (int i = 0; i < numWeapons(*psStruct); i++)
+	{
+		if (psStruct->asWeaps[i].nStat)
+		{
+			WeaponStats* psWeap = &asWeaponStats[psStruct->asWeaps[i].nStat];
+			summary.aa = summary.aa || psWeap->surfaceToAir & SHOOT_IN_AIR;
+			summary.ga = summary.ga || psWeap->surfaceToAir & SHOOT_ON_GROUND;
+			summary.indirect = summary.indirect || psWeap->movementModel == MOVEMENT_MODEL::INDIRECT ||
+			                   psWeap->movementModel == MOVEMENT_MODEL::HOMING_INDIRECT;
+			summary.range = MAX(proj_GetLongRange(psWeap, psStruct->playerManager->getPlayer()), summary.range);
+		}
+	}
+	return summary;
+}
+
+/// What the lazy properties of a converted object are built from, as it was at conversion
+struct LazyObjectSnapshot
+{
+	struct Weapon
+	{
+		const WeaponStats* stats;
+		uint32_t lastFired;
+		int armed; ///< -1 for structures, which have no 'armed' weapon property
+	};
+
+	std::string name;
+	const BodyStats* body = nullptr; ///< droids only
+	const PropulsionStats* propulsion = nullptr; ///< droids only
+	std::vector<Weapon> weapons;
+};
+
+static LazyObjectSnapshot* takeLazyObjectSnapshot(const BaseObject* psObj)
+{
+	auto snapshot = new LazyObjectSnapshot;
+	snapshot->name = objInfo(psObj);
+	if (psObj->type == OBJECT_TYPE::DROID)
+	{
+		auto psDroid = static_cast<const Droid*>(psObj);
+		snapshot->body = &asBodyStats[psDroid->asBits[COMPONENT_TYPE::BODY]];
+		snapshot->propulsion = &asPropulsionStats[psDroid->asBits[COMPONENT_TYPE::PROPULSION]];
+		for (int j = 0; j < psDroid->numWeaps; j++)
+		{
+			snapshot->weapons.push_back({asWeaponStats + psDroid->asWeaps[j].nStat, psDroid->asWeaps[j].timeLastFired,
+			                             droidReloadBar(psDroid, &psDroid->asWeaps[j], j)});
+		}
+	}
+	else if (psObj->type == OBJECT_TYPE::STRUCTURE)
+	{
+		auto psStruct = static_cast<const Structure*>(psObj);
+		for (auto j = 0; j < numWeapons(*psStruct); j++)
+		{
+			const auto& weapon = psStruct->weaponManager->weapons[j];
+			snapshot->weapons.push_back({weapon.stats.get(), weapon.timeLastFired, -1});
+		}
+	}
+	return snapshot;
+}
+
+static void js_lazyObject_finalizer(JSRuntime* rt, JSValue val)
+{
+	delete static_cast<LazyObjectSnapshot*>(JS_GetOpaque(val, lazyObjectClassId));
+}
+
+static JSValue convSnapshotWeapons(JSContext* ctx, const LazyObjectSnapshot& snapshot)
+{
+	JSValue weaponlist = JS_NewArray(ctx);
+	for (size_t j = 0; j < snapshot.weapons.size(); j++)
+	{
+		const LazyObjectSnapshot::Weapon& weaponInfo = snapshot.weapons[j];
+		JSValue weapon = JS_NewObject(ctx);
+		QuickJS_DefinePropertyValue(ctx, weapon, "fullname", JS_NewString(ctx, weaponInfo.stats->name.toUtf8().c_str()),
+		                            JS_PROP_ENUMERABLE);
+		QuickJS_DefinePropertyValue(ctx, weapon, "name", JS_NewString(ctx, weaponInfo.stats->id.toUtf8().c_str()),
+		                            JS_PROP_ENUMERABLE); // will be changed to contain full name
+		QuickJS_DefinePropertyValue(ctx, weapon, "id", JS_NewString(ctx, weaponInfo.stats->id.toUtf8().c_str()),
+		                            JS_PROP_ENUMERABLE);
+		QuickJS_DefinePropertyValue(ctx, weapon, "lastFired", JS_NewUint32(ctx, weaponInfo.lastFired),
+		                            JS_PROP_ENUMERABLE);
+		if (weaponInfo.armed >= 0)
+		{
+			QuickJS_DefinePropertyValue(ctx, weapon, "armed", JS_NewInt32(ctx, weaponInfo.armed), JS_PROP_ENUMERABLE);
+		}
+		JS_DefinePropertyValueUint32(ctx, weaponlist, (uint32_t)j, weapon, JS_PROP_ENUMERABLE);
+	}
+	return weaponlist;
+}
+
+struct LazyObjectProperty
+{
+	const char* name;
+	JSValue (*create)(JSContext* ctx, const LazyObjectSnapshot& snapshot);
+};
+
+/// Indexed by LAZY_PROPERTY
+static const LazyObjectProperty lazyObjectProperties[LAZY_COUNT] = {
+	{"name", [](JSContext* ctx, const LazyObjectSnapshot& snapshot) { return JS_NewString(ctx, snapshot.name.c_str()); }},
+	{"body", [](JSContext* ctx, const LazyObjectSnapshot& snapshot) { return JS_NewString(ctx, snapshot.body->id.toUtf8().c_str()); }},
+	{"propulsion", [](JSContext* ctx, const LazyObjectSnapshot& snapshot) {
+		return JS_NewString(ctx, snapshot.propulsion->id.toUtf8().c_str());
+	}},
+	{"weapons", [](JSContext* ctx, const LazyObjectSnapshot& snapshot) { return convSnapshotWeapons(ctx, snapshot); }},
+};
+
+/// The lazy properties of each object type
+static const std::vector<LAZY_PROPERTY>& lazyPropertiesOf(OBJECT_TYPE type)
+{
+	static const std::vector<LAZY_PROPERTY> droidProperties = {LAZY_NAME, LAZY_BODY, LAZY_PROPULSION, LAZY_WEAPONS};
+	static const std::vector<LAZY_PROPERTY> structureProperties = {LAZY_NAME, LAZY_WEAPONS};
+	static const std::vector<LAZY_PROPERTY> featureProperties = {LAZY_NAME};
+	static const std::vector<LAZY_PROPERTY> none;
+	switch (type)
+	{
+	case OBJECT_TYPE::DROID: return droidProperties;
+	case OBJECT_TYPE::STRUCTURE: return structureProperties;
+	case OBJECT_TYPE::FEATURE: return featureProperties;
+	default: return none;
+	}
+}
+
+static JSValue js_lazyObjectProperty_get(JSContext* ctx, JSValueConst this_val, int magic)
+{
+	auto snapshot = static_cast<const LazyObjectSnapshot*>(JS_GetOpaque(this_val, lazyObjectClassId));
+	if (snapshot == nullptr)
+	{
+		// e.g. read through an object that merely has a game object as its prototype
+		return JS_ThrowTypeError(ctx, "%s: not a game object", lazyObjectProperties[magic].name);
+	}
+	JSValue result = lazyObjectProperties[magic].create(ctx, *snapshot);
+	QuickJS_DefinePropertyValue(ctx, this_val, lazyObjectProperties[magic].name, JS_DupValue(ctx, result), JS_PROP_C_W_E);
+	return result;
+}
+
+static JSValue js_lazyObjectProperty_set(JSContext* ctx, JSValueConst this_val, JSValueConst val, int magic)
+{
+	// Scripts used to be able to overwrite these fields, so keep that working
+	QuickJS_DefinePropertyValue(ctx, this_val, lazyObjectProperties[magic].name, JS_DupValue(ctx, val), JS_PROP_C_W_E);
+	return JS_UNDEFINED;
+}
+
+void quickjs_scripting_instance::defineLazyObjectProperties(JSValue value, OBJECT_TYPE type)
+{
+	for (LAZY_PROPERTY property : lazyPropertiesOf(type))
+	{
+		LazyAccessor& accessor = lazyAccessors[property];
+		if (accessor.atom == JS_ATOM_NULL)
+		{
+			const char* name = lazyObjectProperties[property].name;
+			accessor.atom = JS_NewAtom(ctx, name);
+			accessor.getter = JS_NewCFunction2(ctx, (JSCFunction*)js_lazyObjectProperty_get, name, 0, JS_CFUNC_getter_magic, property);
+			accessor.setter = JS_NewCFunction2(ctx, (JSCFunction*)js_lazyObjectProperty_set, name, 1, JS_CFUNC_setter_magic, property);
+		}
+		JS_DefinePropertyGetSet(ctx, value, accessor.atom, JS_DupValue(ctx, accessor.getter), JS_DupValue(ctx, accessor.setter),
+		                        JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE);
+	}
+}
+
 //;; ## Structure
 //;;
 //;; Describes a structure (building). It inherits all the properties of the base object (see below).
@@ -805,32 +1112,17 @@ JSValue convResearch(const ResearchStats* psResearch, JSContext* ctx, unsigned p
 //;;
 JSValue convStructure(const Structure* psStruct, JSContext* ctx)
 {
-	bool aa = false;
-	bool ga = false;
-	bool indirect = false;
-	int range = -1;
-	for (int i = 0; i < numWeapons(*psStruct); i++)
-	{
-		if (psStruct->asWeaps[i].nStat)
-		{
-			WeaponStats* psWeap = &asWeaponStats[psStruct->asWeaps[i].nStat];
-			aa = aa || psWeap->surfaceToAir & SHOOT_IN_AIR;
-			ga = ga || psWeap->surfaceToAir & SHOOT_ON_GROUND;
-			indirect = indirect || psWeap->movementModel == MOVEMENT_MODEL::INDIRECT ||
-                 psWeap->movementModel == MOVEMENT_MODEL::HOMING_INDIRECT;
-			range = MAX(proj_GetLongRange(psWeap, psStruct->playerManager->getPlayer()), range);
-		}
-	}
+	WeaponSummary weapons = structureWeaponSummary(psStruct);
 	JSValue value = convObj(psStruct, ctx);
 	QuickJS_DefinePropertyValue(ctx, value, "isCB", JS_NewBool(ctx, structCBSensor(psStruct)), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "isSensor", JS_NewBool(ctx, structStandardSensor(psStruct)),
 	                            JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "canHitAir", JS_NewBool(ctx, aa), JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "canHitGround", JS_NewBool(ctx, ga), JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "hasIndirect", JS_NewBool(ctx, indirect), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "canHitAir", JS_NewBool(ctx, weapons.aa), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "canHitGround", JS_NewBool(ctx, weapons.ga), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "hasIndirect", JS_NewBool(ctx, weapons.indirect), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "isRadarDetector", JS_NewBool(ctx, objRadarDetector(psStruct)),
 	                            JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "range", JS_NewInt32(ctx, range), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "range", JS_NewInt32(ctx, weapons.range), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "status", JS_NewInt32(ctx, (int)psStruct->getState()), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "health",
 	                            JS_NewInt32(ctx, 100 * psStruct->damageManager->getHp() / MAX(1, structureBody(psStruct))),
@@ -867,22 +1159,6 @@ JSValue convStructure(const Structure* psStruct, JSContext* ctx)
 	{
 		QuickJS_DefinePropertyValue(ctx, value, "modules", JS_NULL, JS_PROP_ENUMERABLE);
 	}
-	JSValue weaponlist = JS_NewArray(ctx);
-	for (auto j = 0; j < numWeapons(*psStruct); j++)
-	{
-		JSValue weapon = JS_NewObject(ctx);
-		const auto psStats = psStruct->weaponManager->weapons[j].stats;
-		QuickJS_DefinePropertyValue(ctx, weapon, "fullname", JS_NewString(ctx, psStats->name.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE);
-		QuickJS_DefinePropertyValue(ctx, weapon, "name", JS_NewString(ctx, psStats->id.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE); // will be changed to contain full name
-		QuickJS_DefinePropertyValue(ctx, weapon, "id", JS_NewString(ctx, psStats->id.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE);
-		QuickJS_DefinePropertyValue(ctx, weapon, "lastFired", JS_NewUint32(ctx, psStruct->weaponManager->weapons[j].timeLastFired),
-		                            JS_PROP_ENUMERABLE);
-		JS_DefinePropertyValueUint32(ctx, weaponlist, j, weapon, JS_PROP_ENUMERABLE);
-	}
-	QuickJS_DefinePropertyValue(ctx, value, "weapons", weaponlist, JS_PROP_ENUMERABLE);
 	return value;
 }
 
@@ -970,31 +1246,15 @@ JSValue convFeature(const Feature* psFeature, JSContext* ctx)
 //;;
 JSValue convDroid(const Droid* psDroid, JSContext* ctx)
 {
-	bool aa = false;
-	bool ga = false;
-	bool indirect = false;
-	int range = -1;
 	const BodyStats* psBodyStats = &asBodyStats[psDroid->asBits[COMPONENT_TYPE::BODY]];
-
-	for (int i = 0; i < psDroid->numWeaps; i++)
-	{
-		if (psDroid->asWeaps[i].nStat)
-		{
-			WeaponStats* psWeap = &asWeaponStats[psDroid->asWeaps[i].nStat];
-			aa = aa || psWeap->surfaceToAir & SHOOT_IN_AIR;
-			ga = ga || psWeap->surfaceToAir & SHOOT_ON_GROUND;
-			indirect = indirect || psWeap->movementModel == MOVEMENT_MODEL::HOMING_DIRECT ||
-                 psWeap->movementModel == MOVEMENT_MODEL::HOMING_INDIRECT;
-			range = MAX(proj_GetLongRange(psWeap, psDroid->playerManager->getPlayer()), range);
-		}
-	}
+	WeaponSummary weapons = droidWeaponSummary(psDroid);
 	DROID_TYPE type = psDroid->getType();
 	JSValue value = convObj(psDroid, ctx);
 	QuickJS_DefinePropertyValue(ctx, value, "action",
                               JS_NewInt32(ctx, (int)psDroid->getAction()), JS_PROP_ENUMERABLE);
-	if (range >= 0)
+	if (weapons.range >= 0)
 	{
-		QuickJS_DefinePropertyValue(ctx, value, "range", JS_NewInt32(ctx, range), JS_PROP_ENUMERABLE);
+		QuickJS_DefinePropertyValue(ctx, value, "range", JS_NewInt32(ctx, weapons.range), JS_PROP_ENUMERABLE);
 	}
 	else
 	{
@@ -1002,7 +1262,7 @@ JSValue convDroid(const Droid* psDroid, JSContext* ctx)
 	}
 	QuickJS_DefinePropertyValue(ctx, value, "order", JS_NewInt32(ctx, (int)psDroid->getOrder()->type), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "cost", JS_NewUint32(ctx, calcDroidPower(psDroid)), JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "hasIndirect", JS_NewBool(ctx, indirect), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "hasIndirect", JS_NewBool(ctx, weapons.indirect), JS_PROP_ENUMERABLE);
 	switch (psDroid->getType()) // hide some engine craziness
 	{
     case DROID_TYPE::CYBORG_CONSTRUCT:
@@ -1037,8 +1297,8 @@ JSValue convDroid(const Droid* psDroid, JSContext* ctx)
 	QuickJS_DefinePropertyValue(ctx, value, "isCB", JS_NewBool(ctx, cbSensorDroid(psDroid)), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "isSensor", JS_NewBool(ctx, standardSensorDroid(psDroid)),
 	                            JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "canHitAir", JS_NewBool(ctx, aa), JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "canHitGround", JS_NewBool(ctx, ga), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "canHitAir", JS_NewBool(ctx, weapons.aa), JS_PROP_ENUMERABLE);
+	QuickJS_DefinePropertyValue(ctx, value, "canHitGround", JS_NewBool(ctx, weapons.ga), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "isVTOL", JS_NewBool(ctx, psDroid->isVtol()), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "droidType", JS_NewInt32(ctx, (int)type), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "experience", JS_NewFloat64(ctx, (double)psDroid->experience / 65536.0),
@@ -1047,34 +1307,7 @@ JSValue convDroid(const Droid* psDroid, JSContext* ctx)
 	                            JS_NewFloat64(ctx, 100.0 / (double)psDroid->damageManager->getOriginalHp() *
                                                          (double)psDroid->damageManager->getHp()),
 	                            JS_PROP_ENUMERABLE);
-
-	QuickJS_DefinePropertyValue(ctx, value, "body",
-	                            JS_NewString(ctx, asBodyStats[psDroid->asBits[COMPONENT_TYPE::BODY]].id.toUtf8().c_str()),
-	                            JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "propulsion",
-	                            JS_NewString(
-		                            ctx, asPropulsionStats[psDroid->asBits[COMPONENT_TYPE::PROPULSION]].id.toUtf8().c_str()),
-	                            JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "armed", JS_NewFloat64(ctx, 0.0), JS_PROP_ENUMERABLE); // deprecated!
-
-	JSValue weaponlist = JS_NewArray(ctx);
-	for (int j = 0; j < psDroid->numWeaps; j++)
-	{
-		int armed = droidReloadBar(psDroid, &psDroid->asWeaps[j], j);
-		JSValue weapon = JS_NewObject(ctx);
-		const WeaponStats* psStats = asWeaponStats + psDroid->asWeaps[j].nStat;
-		QuickJS_DefinePropertyValue(ctx, weapon, "fullname", JS_NewString(ctx, psStats->name.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE);
-		QuickJS_DefinePropertyValue(ctx, weapon, "name", JS_NewString(ctx, psStats->id.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE); // will be changed to contain full name
-		QuickJS_DefinePropertyValue(ctx, weapon, "id", JS_NewString(ctx, psStats->id.toUtf8().c_str()),
-		                            JS_PROP_ENUMERABLE);
-		QuickJS_DefinePropertyValue(ctx, weapon, "lastFired", JS_NewUint32(ctx, psDroid->asWeaps[j].timeLastFired),
-		                            JS_PROP_ENUMERABLE);
-		QuickJS_DefinePropertyValue(ctx, weapon, "armed", JS_NewInt32(ctx, armed), JS_PROP_ENUMERABLE);
-		JS_DefinePropertyValueUint32(ctx, weaponlist, j, weapon, JS_PROP_ENUMERABLE);
-	}
-	QuickJS_DefinePropertyValue(ctx, value, "weapons", weaponlist, JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "cargoSize", JS_NewInt32(ctx, transporterSpaceRequired(psDroid)),
 	                            JS_PROP_ENUMERABLE);
 	return value;
@@ -1100,10 +1333,16 @@ JSValue convDroid(const Droid* psDroid, JSContext* ctx)
 //;; * ```thermal``` Amount of thermal protection that protect against heat based weapons.
 //;; * ```born``` The game time at which this object was produced or came into the world. (3.2+ only)
 //;;
+//;; Like all other properties, ```name``` and the droid and structure properties ```body```, ```propulsion```
+//;; and ```weapons``` describe the object as it was when it was handed to the script, even though they are
+//;; only built the first time they are read. (4.3+ only)
+//;;
 JSValue convObj(BaseObject const* psObj, JSContext* ctx)
 {
-	JSValue value = JS_NewObject(ctx);
-	ASSERT_OR_RETURN(value, psObj, "No object for conversion");
+	ASSERT_OR_RETURN(JS_NewObject(ctx), psObj, "No object for conversion");
+	quickjs_scripting_instance* instance = engineToInstanceMap.at(ctx);
+	JSValue value = JS_NewObjectClass(ctx, lazyObjectClassId);
+	JS_SetOpaque(value, takeLazyObjectSnapshot(psObj));
 	QuickJS_DefinePropertyValue(ctx, value, "id",
                               JS_NewUint32(ctx, psObj->getId()), 0);
 	QuickJS_DefinePropertyValue(ctx, value, "x",
@@ -1127,11 +1366,9 @@ JSValue convObj(BaseObject const* psObj, JSContext* ctx)
                               JS_NewInt32(ctx, psObj->type), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "selected",
                               JS_NewUint32(ctx, psObj->damageManager->isSelected()), JS_PROP_ENUMERABLE);
-	QuickJS_DefinePropertyValue(ctx, value, "name",
-                              JS_NewString(ctx, objInfo(psObj)), JS_PROP_ENUMERABLE);
 	QuickJS_DefinePropertyValue(ctx, value, "born",
                               JS_NewUint32(ctx, psObj->born), JS_PROP_ENUMERABLE);
-	scripting_engine::GROUPMAP* psMap = scripting_engine::instance().getGroupMap(engineToInstanceMap.at(ctx));
+	scripting_engine::GROUPMAP* psMap = scripting_engine::instance().getGroupMap(instance);
 	if (psMap != nullptr && psMap->map().count(psObj) > 0) // FIXME:
 	{
 		int group = psMap->map().at(psObj); // FIXME:
@@ -1141,6 +1378,7 @@ JSValue convObj(BaseObject const* psObj, JSContext* ctx)
 	{
 		QuickJS_DefinePropertyValue(ctx, value, "group", JS_NULL, JS_PROP_ENUMERABLE);
 	}
+	instance->defineLazyObjectProperties(value, psObj->type);
 	return value;
 }
 
@@ -1257,10 +1495,18 @@ static JSValue callFunction(JSContext* ctx, const std::string& function, std::ve
 	}
 
 	JSValue result;
+	if (instance->profilingStacks())
+	{
+		instance->beginProfiledCall();
+	}
 	scripting_engine::instance().executeWithPerformanceMonitoring(instance, function, [ctx, &result, value, &args]()
 	{
 		result = JS_Call(ctx, value, JS_UNDEFINED, (int)args.size(), args.data());
 	});
+	if (instance->profilingStacks())
+	{
+		instance->endProfiledCall(function);
+	}
 
 	if (JS_IsException(result))
 	{
@@ -2439,6 +2685,119 @@ static std::string QuickJS_DumpError(JSContext* ctx)
 	return result;
 }
 
+// MARK: Bytecode cache
+//
+// The bigger AIs and their includes take a while to compile, and the same files are compiled again for
+// every player instance and every game. Compiled bytecode is kept in memory for the rest of the session,
+// and in the write directory for later sessions, keyed by a hash of the file name, source and build.
+//
+// JS_ReadObject() trusts its input completely, so cache files are only read from the write directory
+// itself. Maps and mods are mounted at the root of the search path and could otherwise supply their own.
+// Each file starts with a SHA-256 of the bytecode, so a file left half written by a crash, or damaged
+// since, is thrown away rather than read. The directory is pruned to the most recently written files.
+
+#define JS_BYTECODE_CACHE_DIR "cache/jsbytecode"
+#define JS_BYTECODE_CACHE_MAX_FILES 256
+
+static std::unordered_map<std::string, std::vector<uint8_t>> bytecodeCache;
+
+static std::string bytecodeCacheKey(const char* source, size_t size, const std::string& filename)
+{
+	std::string keyData = version_getVersionString();
+	keyData.push_back('\0');
+	keyData.append(js_debugger_get_bytecode_version());
+	keyData.push_back('\0');
+	keyData.append(filename);
+	keyData.push_back('\0');
+	keyData.append(source, size);
+	return sha256Sum(keyData.data(), keyData.size()).toString();
+}
+
+/// Whether the file exists and comes from the write directory, rather than from some other part of the search path
+static bool isBytecodeCacheFile(const std::string& cachePath)
+{
+	if (!PHYSFS_exists(cachePath.c_str()))
+	{
+		return false;
+	}
+	const char* realDir = PHYSFS_getRealDir(cachePath.c_str());
+	const char* writeDir = PHYSFS_getWriteDir();
+	return realDir != nullptr && writeDir != nullptr && strcmp(realDir, writeDir) == 0;
+}
+
+/// Compile a script for later use with JS_EvalFunction(), reusing the bytecode from an earlier compile of the same
+/// source where possible. Like JS_Eval() with JS_EVAL_FLAG_COMPILE_ONLY, returns an exception on syntax errors.
+static JSValue QuickJS_CompileScript(JSContext* ctx, const char* source, size_t size, const std::string& filename)
+{
+	const std::string key = bytecodeCacheKey(source, size, filename);
+	const std::string cachePath = JS_BYTECODE_CACHE_DIR "/" + key + ".qjsbc";
+	auto it = bytecodeCache.find(key);
+	if (it == bytecodeCache.end() && isBytecodeCacheFile(cachePath))
+	{
+		std::vector<char> fileData;
+		if (loadFileToBufferVector(cachePath.c_str(), fileData, false, false))
+		{
+			Sha256 storedHash;
+			if (fileData.size() > Sha256::Bytes)
+			{
+				memcpy(storedHash.bytes, fileData.data(), Sha256::Bytes);
+			}
+			if (fileData.size() > Sha256::Bytes
+				&& sha256Sum(fileData.data() + Sha256::Bytes, fileData.size() - Sha256::Bytes) == storedHash)
+			{
+				it = bytecodeCache.emplace(key, std::vector<uint8_t>(fileData.begin() + Sha256::Bytes, fileData.end())).first;
+			}
+			else
+			{
+				debug(LOG_SCRIPT, "Discarding damaged bytecode cache file for %s", filename.c_str());
+				PHYSFS_delete(cachePath.c_str());
+			}
+		}
+	}
+	if (it != bytecodeCache.end())
+	{
+		JSValue compiled = JS_ReadObject(ctx, it->second.data(), it->second.size(), JS_READ_OBJ_BYTECODE);
+		if (!JS_IsException(compiled))
+		{
+			return compiled;
+		}
+		// Most likely written by a different QuickJS version, so just compile it again
+		JS_FreeValue(ctx, JS_GetException(ctx));
+		debug(LOG_SCRIPT, "Discarding cached bytecode for %s", filename.c_str());
+		bytecodeCache.erase(it);
+	}
+
+	JSValue compiled = JS_Eval(ctx, source, size, filename.c_str(), JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+	if (JS_IsException(compiled))
+	{
+		return compiled;
+	}
+	size_t bytecodeSize = 0;
+	uint8_t* bytecode = JS_WriteObject(ctx, &bytecodeSize, compiled, JS_WRITE_OBJ_BYTECODE);
+	if (bytecode != nullptr)
+	{
+		std::vector<uint8_t>& cached = bytecodeCache[key];
+		cached.assign(bytecode, bytecode + bytecodeSize);
+		js_free(ctx, bytecode);
+		if (PHYSFS_mkdir(JS_BYTECODE_CACHE_DIR))
+		{
+			static bool cachePruned = false;
+			if (!cachePruned)
+			{
+				cachePruned = true;
+				WZ_PHYSFS_cleanupOldFilesInFolder(JS_BYTECODE_CACHE_DIR, ".qjsbc", JS_BYTECODE_CACHE_MAX_FILES - 1, [](const char* fileName) {
+					return PHYSFS_delete(fileName) != 0;
+				});
+			}
+			Sha256 hash = sha256Sum(cached.data(), cached.size());
+			std::vector<char> fileData(hash.bytes, hash.bytes + Sha256::Bytes);
+			fileData.insert(fileData.end(), cached.begin(), cached.end());
+			saveFile(cachePath.c_str(), fileData.data(), static_cast<UDWORD>(fileData.size()));
+		}
+	}
+	return compiled;
+}
+
 //-- ## include(filePath)
 //-- Includes another source code file at this point. You should generally only specify the filename,
 //-- not try to specify its path, here.
@@ -2460,8 +2819,7 @@ static JSValue js_include(JSContext* ctx, JSValueConst this_val, int argc, JSVal
 		JS_ThrowReferenceError(ctx, "Failed to read include file \"%s\"", filePath.c_str());
 		return JS_FALSE;
 	}
-	JSValue compiledFuncObj = JS_Eval(ctx, bytes, size, loadedFilePath.c_str(),
-	                                  JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+	JSValue compiledFuncObj = QuickJS_CompileScript(ctx, bytes, size, loadedFilePath);
 	free(bytes);
 	if (JS_IsException(compiledFuncObj))
 	{
@@ -2563,6 +2921,8 @@ static uniqueTimerID SetQuickJSTimer(JSContext* ctx, unsigned player, const std:
 //-- parameter can be a **game object** to pass to the timer function. If the **game object**
 //-- dies, the timer stops running. The minimum number of milliseconds is 100, but such
 //-- fast timers are strongly discouraged as they may deteriorate the game performance.
+//-- So that timers set up at the same time don't all run on the same game tick, the
+//-- first call comes after between one and two intervals.
 //--
 //-- ```javascript
 //-- function conDroids()
@@ -2650,7 +3010,8 @@ static JSValue js_removeTimer(JSContext* ctx, JSValueConst this_val, int argc, J
 //-- The second parameter is the delay in milliseconds, if it is omitted or 0,
 //-- the function will be run at a later frame.  A third optional
 //-- parameter can be a **game object** to pass to the queued function. If the **game object**
-//-- dies before the queued call runs, nothing happens.
+//-- dies before the queued call runs, nothing happens. If a script has a lot of calls
+//-- queued up for the same frame, some of them are run in the following frames.
 //--
 // TODO, check if an identical call is already queued up - and in this case,
 // do not add anything.
@@ -2821,8 +3182,7 @@ bool quickjs_scripting_instance::loadScript(const WzString& path, unsigned playe
 		calcDataHash(reinterpret_cast<const uint8_t*>(bytes), size, DATA_SCRIPT);
 	}
 	m_path = path.toUtf8();
-	compiledScriptObj = JS_Eval(ctx, bytes, size, path.toUtf8().c_str(),
-	                            JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+	compiledScriptObj = QuickJS_CompileScript(ctx, bytes, size, m_path);
 	free(bytes);
 	if (JS_IsException(compiledScriptObj))
 	{
@@ -3312,6 +3672,8 @@ IMPL_JS_FUNC(getScrollLimits, wzapi::getScrollLimits)
 IMPL_JS_FUNC(loadLevel, wzapi::loadLevel)
 IMPL_JS_FUNC(autoSave, wzapi::autoSave)
 IMPL_JS_FUNC(enumRange, wzapi::enumRange)
+IMPL_JS_FUNC(enumRangeSorted, wzapi::enumRangeSorted)
+IMPL_JS_FUNC(findNearest, wzapi::findNearest)
 IMPL_JS_FUNC(enumArea, scripting_engine::enumAreaJS)
 IMPL_JS_FUNC(addBeacon, wzapi::addBeacon)
 
@@ -3572,6 +3934,8 @@ bool quickjs_scripting_instance::registerFunctions(const std::string& scriptName
 	JS_REGISTER_FUNC(enumSelected, 0); // WZAPI
 	JS_REGISTER_FUNC(enumResearch, 0); // WZAPI
 	JS_REGISTER_FUNC2(enumRange, 3, 5); // WZAPI
+	JS_REGISTER_FUNC2(enumRangeSorted, 3, 7); // WZAPI
+	JS_REGISTER_FUNC2(findNearest, 3, 6); // WZAPI
 	JS_REGISTER_FUNC2(enumArea, 1, 6); // scripting_engine
 	JS_REGISTER_FUNC2(getResearch, 1, 2); // WZAPI
 	JS_REGISTER_FUNC(pursueResearch, 2); // WZAPI
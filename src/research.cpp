@@ -36,6 +36,9 @@
 #include "lib/ivis_opengl/imd.h"
 #include "objmem.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 // The stores for the research stats
 std::vector<ResearchStats> asResearch;
 nlohmann::json cachedStatsObject = nlohmann::json(nullptr);
@@ -56,6 +59,10 @@ unsigned aDefaultRepair[MAX_PLAYERS];
 
 std::vector<PlayerUpgradeCounts> playerUpgradeCounts;
 
+/// Per player and research goal, the prerequisites of the goal in the order pursueResearch() tries them.
+/// Topics the player has completed are dropped as they are found, so the lists shrink over a game.
+static std::unordered_map<unsigned, std::vector<unsigned>> researchPaths[MAX_PLAYERS];
+
 nonstd::optional< std::deque<ResearchStats*> > CycleDetection::explore(ResearchStats* research)
 {
   if (visited.find(research) != visited.end())
@@ -126,6 +133,7 @@ bool researchInitVars()
 
 	for (int i = 0; i < MAX_PLAYERS; i++)
 	{
+		researchPaths[i].clear();
 		bSelfRepair[i] = false;
 		aDefaultSensor[i] = 0;
 		aDefaultECM[i] = 0;
@@ -585,6 +593,55 @@ bool loadResearch(WzConfig& ini)
 	return true;
 }
 
+std::vector<unsigned> const& researchPathTowards(unsigned goal, unsigned player)
+{
+	static const std::vector<unsigned> noPath;
+	ASSERT_OR_RETURN(noPath, goal < asResearch.size() && player < MAX_PLAYERS, "Bad research %u or player %u", goal, player);
+	auto inserted = researchPaths[player].emplace(goal, std::vector<unsigned>());
+	std::vector<unsigned>& path = inserted.first->second;
+	if (!inserted.second)
+	{
+		path.erase(std::remove_if(path.begin(), path.end(), [player](unsigned index) {
+			return IsResearchCompleted(&asPlayerResList[player][index]);
+		}), path.end());
+		return path;
+	}
+
+	// Follow the first prerequisite of each topic, putting the others aside until a topic without any is found.
+	// Topics reached twice are only listed the first time, which also stops at cyclic prerequisites.
+	std::vector<bool> visited(asResearch.size(), false);
+	std::deque<unsigned> postponed;
+	unsigned current = goal;
+	while (true)
+	{
+		if (!visited[current])
+		{
+			visited[current] = true;
+			if (!IsResearchCompleted(&asPlayerResList[player][current]))
+			{
+				path.push_back(current);
+			}
+			auto const& prerequisites = asResearch[current].pPRList;
+			for (size_t i = 1; i < prerequisites.size(); ++i)
+			{
+				postponed.push_back(prerequisites[i]);
+			}
+			if (!prerequisites.empty())
+			{
+				current = prerequisites[0];
+				continue;
+			}
+		}
+		if (postponed.empty())
+		{
+			break;
+		}
+		current = postponed.front();
+		postponed.pop_front();
+	}
+	return path;
+}
+
 bool researchAvailable(int inc, UDWORD playerID, QUEUE_MODE mode)
 {
 	if (playerID >= MAX_PLAYERS)
@@ -1161,6 +1218,10 @@ void ResearchRelease()
 	{
 		i.clear();
 	}
+	for (auto& paths : researchPaths)
+	{
+		paths.clear();
+	}
 	cachedStatsObject = nlohmann::json(nullptr);
 	cachedPerPlayerUpgrades.clear();
 	playerUpgradeCounts = std::vector<PlayerUpgradeCounts>(MAX_PLAYERS);
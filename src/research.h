@@ -297,6 +297,10 @@ bool researchInitVars();
 
 bool researchAvailable(int inc, unsigned playerID, QUEUE_MODE mode);
 
+/// The topics not yet completed by the player on the way to the goal (the goal included), in the order
+/// they should be started. Built on first use for each goal, and pruned of completed topics on later uses.
+std::vector<unsigned> const& researchPathTowards(unsigned goal, unsigned player);
+
 std::vector<AllyResearch> const& listAllyResearch(unsigned ref);
 
 // various counts / statistics
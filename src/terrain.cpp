@@ -30,8 +30,12 @@
  */
 
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include "lib/framework/frame.h"
+#include "lib/framework/wzapp.h"
 #include "lib/framework/opengl.h"
 #include "lib/ivis_opengl/tex.h"
 #include "lib/ivis_opengl/pietypes.h"
@@ -79,6 +83,8 @@ struct Sector
 	int decalSize; ///< Size of the part of the decal VBO we are going to use
 	bool draw; ///< Do we draw this sector this frame?
 	bool dirty; ///< Do we need to update the geometry for this sector?
+	bool generated; ///< Has the geometry for this sector been uploaded at least once?
+	bool pending; ///< Is a rebuild of this sector queued on / being done by the sector thread?
 };
 
 using RenderVertex = Vector3f;
@@ -307,6 +313,57 @@ static void averagePos(Vector3i* center, Vector3i* a, Vector3i* b, Vector3i* c,
 	center->z = (a->z + b->z + c->z + d->z) / 4;
 }
 
+/**
+ * A copy of the map data the geometry of one sector is built from,
+ * so the geometry can be built on the sector thread while the map keeps changing.
+ * Covers (sectorSize + 2) x (sectorSize + 2) tiles starting at the sector's first tile.
+ */
+struct SectorTiles
+{
+	int originX = 0; ///< Map position of the first tile in the copy
+	int originY = 0;
+	int size = 0; ///< Width and height of the copy in tiles
+	int width = 0; ///< Size of the map the copy was taken from
+	int height = 0;
+	std::vector<int> tileHeight;
+	std::vector<int> waterLevel;
+	std::vector<uint16_t> texture;
+	std::vector<uint8_t> tileInfoBits;
+
+	inline size_t index(int x, int y) const
+	{
+		ASSERT(x >= originX && y >= originY && x < originX + size && y < originY + size, "Tile (%d, %d) is not in the copy", x, y);
+		return (y - originY) * size + (x - originX);
+	}
+};
+
+/// Copy the map data needed to build the geometry of a sector
+static void copySectorTiles(SectorTiles* tiles, int x, int y)
+{
+	tiles->originX = x * sectorSize;
+	tiles->originY = y * sectorSize;
+	tiles->size = sectorSize + 2;
+	tiles->width = mapWidth;
+	tiles->height = mapHeight;
+	const size_t count = tiles->size * tiles->size;
+	tiles->tileHeight.assign(count, 0);
+	tiles->waterLevel.assign(count, 0);
+	tiles->texture.assign(count, 0);
+	tiles->tileInfoBits.assign(count, 0);
+	for (int j = tiles->originY; j < tiles->originY + tiles->size && j < mapHeight; j++)
+	{
+		for (int i = tiles->originX; i < tiles->originX + tiles->size && i < mapWidth; i++)
+		{
+			const Tile* psTile = mapTile(i, j);
+			const size_t idx = tiles->index(i, j);
+			tiles->tileHeight[idx] = psTile->height;
+			tiles->waterLevel[idx] = psTile->waterLevel;
+			tiles->texture[idx] = psTile->texture;
+			tiles->tileInfoBits[idx] = psTile->tileInfoBits;
+		}
+	}
+}
+
 /// Is this position next to a water tile?
 static bool isWater(int x, int y)
 {
@@ -319,32 +376,28 @@ static bool isWater(int x, int y)
 }
 
 /// Get the position of a grid point
-static void getGridPos(Vector3i* result, int x, int y, bool center, bool water)
+static void getGridPos(const SectorTiles& tiles, Vector3i* result, int x, int y, bool center, bool water)
 {
 	if (center)
 	{
 		Vector3i a, b, c, d;
-		getGridPos(&a, x, y, false, water);
-		getGridPos(&b, x + 1, y, false, water);
-		getGridPos(&c, x, y + 1, false, water);
-		getGridPos(&d, x + 1, y + 1, false, water);
+		getGridPos(tiles, &a, x, y, false, water);
+		getGridPos(tiles, &b, x + 1, y, false, water);
+		getGridPos(tiles, &c, x, y + 1, false, water);
+		getGridPos(tiles, &d, x + 1, y + 1, false, water);
 		averagePos(result, &a, &b, &c, &d);
 		return;
 	}
 	result->x = world_coord(x);
 	result->z = world_coord(-y);
 
-	if (x <= 0 || y <= 0 || x >= mapWidth || y >= mapHeight)
+	if (x <= 0 || y <= 0 || x >= tiles.width || y >= tiles.height)
 	{
 		result->y = 0;
 	}
 	else
 	{
-		result->y = map_TileHeight(x, y);
-		if (water)
-		{
-			result->y = map_WaterHeight(x, y);
-		}
+		result->y = (water) ? tiles.waterLevel[tiles.index(x, y)] : tiles.tileHeight[tiles.index(x, y)];
 	}
 }
 
@@ -361,7 +414,7 @@ static inline void averageColour(PIELIGHT* average, PIELIGHT a, PIELIGHT b,
 /**
  * Set the terrain and water geometry for the specified sector
  */
-static void setSectorGeometry(int x, int y,
+static void setSectorGeometry(const SectorTiles& tiles, int x, int y,
                               RenderVertex* geometry, RenderVertex* water,
                               int* geometrySize, int* waterSize)
 {
@@ -372,25 +425,25 @@ static void setSectorGeometry(int x, int y,
 		for (j = 0; j < sectorSize + 1; j++)
 		{
 			// set up geometry
-			getGridPos(&pos, i + x * sectorSize, j + y * sectorSize, false, false);
+			getGridPos(tiles, &pos, i + x * sectorSize, j + y * sectorSize, false, false);
 			geometry[*geometrySize].x = pos.x;
 			geometry[*geometrySize].y = pos.y;
 			geometry[*geometrySize].z = pos.z;
 			(*geometrySize)++;
 
-			getGridPos(&pos, i + x * sectorSize, j + y * sectorSize, true, false);
+			getGridPos(tiles, &pos, i + x * sectorSize, j + y * sectorSize, true, false);
 			geometry[*geometrySize].x = pos.x;
 			geometry[*geometrySize].y = pos.y;
 			geometry[*geometrySize].z = pos.z;
 			(*geometrySize)++;
 
-			getGridPos(&pos, i + x * sectorSize, j + y * sectorSize, false, true);
+			getGridPos(tiles, &pos, i + x * sectorSize, j + y * sectorSize, false, true);
 			water[*waterSize].x = pos.x;
 			water[*waterSize].y = pos.y;
 			water[*waterSize].z = pos.z;
 			(*waterSize)++;
 
-			getGridPos(&pos, i + x * sectorSize, j + y * sectorSize, true, true);
+			getGridPos(tiles, &pos, i + x * sectorSize, j + y * sectorSize, true, true);
 			water[*waterSize].x = pos.x;
 			water[*waterSize].y = pos.y;
 			water[*waterSize].z = pos.z;
@@ -402,7 +455,7 @@ static void setSectorGeometry(int x, int y,
 /**
  * Set the decals for a sector. This takes care of both the geometry and the texture part.
  */
-static void setSectorDecals(int x, int y, DecalVertex* decaldata, int* decalSize)
+static void setSectorDecals(const SectorTiles& tiles, int x, int y, DecalVertex* decaldata, int* decalSize)
 {
 	Vector3i pos;
 	Vector2f uv[2][2], center;
@@ -413,78 +466,78 @@ static void setSectorDecals(int x, int y, DecalVertex* decaldata, int* decalSize
 	{
 		for (j = y * sectorSize; j < y * sectorSize + sectorSize; j++)
 		{
-			if (i < 0 || j < 0 || i >= mapWidth || j >= mapHeight)
+			if (i < 0 || j < 0 || i >= tiles.width || j >= tiles.height)
 			{
 				continue;
 			}
-			if (TILE_HAS_DECAL(mapTile(i, j)))
+			if (tiles.tileInfoBits[tiles.index(i, j)] & BITS_DECAL)
 			{
-				center = getTileTexCoords(*uv, mapTile(i, j)->texture);
+				center = getTileTexCoords(*uv, tiles.texture[tiles.index(i, j)]);
 
-				getGridPos(&pos, i, j, true, false);
+				getGridPos(tiles, &pos, i, j, true, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = center;
 				(*decalSize)++;
 				a = 0;
 				b = 1;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 				a = 0;
 				b = 0;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 
-				getGridPos(&pos, i, j, true, false);
+				getGridPos(tiles, &pos, i, j, true, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = center;
 				(*decalSize)++;
 				a = 1;
 				b = 1;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 				a = 0;
 				b = 1;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 
-				getGridPos(&pos, i, j, true, false);
+				getGridPos(tiles, &pos, i, j, true, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = center;
 				(*decalSize)++;
 				a = 1;
 				b = 0;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 				a = 1;
 				b = 1;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 
-				getGridPos(&pos, i, j, true, false);
+				getGridPos(tiles, &pos, i, j, true, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = center;
 				(*decalSize)++;
 				a = 0;
 				b = 0;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
 				a = 1;
 				b = 0;
-				getGridPos(&pos, i + a, j + b, false, false);
+				getGridPos(tiles, &pos, i + a, j + b, false, false);
 				decaldata[*decalSize].pos = pos;
 				decaldata[*decalSize].uv = uv[a][b];
 				(*decalSize)++;
@@ -493,52 +546,90 @@ static void setSectorDecals(int x, int y, DecalVertex* decaldata, int* decalSize
 	}
 }
 
+/// Number of terrain (and water) vertices in every sector
+static inline int sectorVertexCount()
+{
+	return (sectorSize + 1) * (sectorSize + 1) * 2;
+}
+
+/// Number of decal vertices in a sector
+static int countSectorDecalVertices(int x, int y)
+{
+	int count = 0;
+	for (int i = x * sectorSize; i < x * sectorSize + sectorSize && i < mapWidth; i++)
+	{
+		for (int j = y * sectorSize; j < y * sectorSize + sectorSize && j < mapHeight; j++)
+		{
+			if (TILE_HAS_DECAL(mapTile(i, j)))
+			{
+				count += 12;
+			}
+		}
+	}
+	return count;
+}
+
 /**
- * Update the sector for when the terrain is changed.
+ * The geometry of one sector, built from a copy of the map.
+ * Built on the sector thread for rebuilds, and uploaded by the render thread on the next frame.
  */
-static void updateSectorGeometry(int x, int y)
+struct SectorGeometry
+{
+	int x = 0, y = 0;
+	SectorTiles tiles;
+	std::vector<RenderVertex> geometry;
+	std::vector<RenderVertex> water;
+	std::vector<DecalVertex> decals;
+};
+
+static void buildSectorGeometry(SectorGeometry& data)
 {
-	RenderVertex* geometry;
-	RenderVertex* water;
-	DecalVertex* decaldata;
 	int geometrySize = 0;
 	int waterSize = 0;
 	int decalSize = 0;
 
-	geometry = (RenderVertex*)malloc(sizeof(RenderVertex) * sectors[x * ySectors + y].geometrySize);
-	water = (RenderVertex*)malloc(sizeof(RenderVertex) * sectors[x * ySectors + y].waterSize);
+	data.geometry.resize(sectorVertexCount());
+	data.water.resize(sectorVertexCount());
+	setSectorGeometry(data.tiles, data.x, data.y, data.geometry.data(), data.water.data(), &geometrySize, &waterSize);
+	ASSERT(geometrySize == sectorVertexCount() && waterSize == sectorVertexCount(), "something went seriously wrong updating the terrain");
+
+	data.decals.resize(sectorSize * sectorSize * 12);
+	setSectorDecals(data.tiles, data.x, data.y, data.decals.data(), &decalSize);
+	data.decals.resize(decalSize);
+}
+
+/**
+ * Upload the geometry of a sector to the VBOs.
+ */
+static void uploadSectorGeometry(const SectorGeometry& data)
+{
+	Sector& sector = sectors[data.x * ySectors + data.y];
 
-	setSectorGeometry(x, y, geometry, water, &geometrySize, &waterSize);
-	ASSERT(geometrySize == sectors[x * ySectors + y].geometrySize,
-	       "something went seriously wrong updating the terrain");
-	ASSERT(waterSize == sectors[x * ySectors + y].waterSize, "something went seriously wrong updating the terrain");
+	ASSERT_OR_RETURN(, static_cast<int>(data.geometry.size()) == sector.geometrySize, "something went seriously wrong updating the terrain");
+	ASSERT_OR_RETURN(, static_cast<int>(data.water.size()) == sector.waterSize, "something went seriously wrong updating the terrain");
 
-	geometryVBO->update(sizeof(RenderVertex) * sectors[x * ySectors + y].geometryOffset,
-	                    sizeof(RenderVertex) * sectors[x * ySectors + y].geometrySize, geometry,
+	geometryVBO->update(sizeof(RenderVertex) * sector.geometryOffset,
+	                    sizeof(RenderVertex) * sector.geometrySize, data.geometry.data(),
 	                    gfx_api::buffer::update_flag::non_overlapping_updates_promise);
-	waterVBO->update(sizeof(RenderVertex) * sectors[x * ySectors + y].waterOffset,
-	                 sizeof(RenderVertex) * sectors[x * ySectors + y].waterSize, water,
+	waterVBO->update(sizeof(RenderVertex) * sector.waterOffset,
+	                 sizeof(RenderVertex) * sector.waterSize, data.water.data(),
 	                 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
+	sector.generated = true;
 
-	free(geometry);
-	free(water);
-
-	if (sectors[x * ySectors + y].decalSize <= 0)
+	if (sector.decalSize <= 0)
 	{
 		// Nothing to do here, and glBufferSubData(GL_ARRAY_BUFFER, 0, 0, *) crashes in my graphics driver. Probably shouldn't crash...
 		return;
 	}
 
-	decaldata = (DecalVertex*)malloc(sizeof(DecalVertex) * sectors[x * ySectors + y].decalSize);
-	setSectorDecals(x, y, decaldata, &decalSize);
-	ASSERT(decalSize == sectors[x * ySectors + y].decalSize, "the amount of decals has changed");
+	ASSERT(static_cast<int>(data.decals.size()) == sector.decalSize, "the amount of decals has changed");
 
-	if (decalSize > 0)
+	if (!data.decals.empty())
 	{
 		if (decalVBO)
 		{
-			decalVBO->update(sizeof(DecalVertex) * sectors[x * ySectors + y].decalOffset,
-			                 sizeof(DecalVertex) * sectors[x * ySectors + y].decalSize, decaldata,
+			decalVBO->update(sizeof(DecalVertex) * sector.decalOffset,
+			                 sizeof(DecalVertex) * std::min<size_t>(sector.decalSize, data.decals.size()), data.decals.data(),
 			                 gfx_api::buffer::update_flag::non_overlapping_updates_promise);
 		}
 		else
@@ -548,13 +639,126 @@ static void updateSectorGeometry(int x, int y)
 			ASSERT(false, "Didn't have decals, but now we do. Unsupported.");
 		}
 	}
+}
+
+/*
+ * Sector thread
+ * Rebuilds the geometry of changed sectors in the background. The render thread uploads the results on the next frame,
+ * and keeps drawing the old geometry until then.
+ */
+
+static WZ_THREAD* sectorThread = nullptr;
+static WZ_MUTEX* sectorMutex = nullptr;
+static WZ_SEMAPHORE* sectorSemaphore = nullptr;
+static bool sectorThreadQuit = false;
+static std::deque<std::unique_ptr<SectorGeometry>> sectorJobs; ///< Waiting to be built
+static std::vector<std::unique_ptr<SectorGeometry>> sectorResults; ///< Built, waiting to be uploaded
+
+static int sectorThreadFunc(void*)
+{
+	wzMutexLock(sectorMutex);
+	while (!sectorThreadQuit)
+	{
+		if (sectorJobs.empty())
+		{
+			wzMutexUnlock(sectorMutex);
+			wzSemaphoreWait(sectorSemaphore); // Go to sleep until needed.
+			wzMutexLock(sectorMutex);
+			continue;
+		}
+		std::unique_ptr<SectorGeometry> job = std::move(sectorJobs.front());
+		sectorJobs.pop_front();
+		wzMutexUnlock(sectorMutex);
+
+		buildSectorGeometry(*job);
+
+		wzMutexLock(sectorMutex);
+		sectorResults.push_back(std::move(job));
+	}
+	wzMutexUnlock(sectorMutex);
+	return 0;
+}
+
+static void startSectorThread()
+{
+	if (sectorThread != nullptr)
+	{
+		return;
+	}
+	sectorThreadQuit = false;
+	sectorMutex = wzMutexCreate();
+	sectorSemaphore = wzSemaphoreCreate(0);
+	sectorThread = wzThreadCreate(sectorThreadFunc, nullptr);
+	wzThreadStart(sectorThread);
+}
+
+static void stopSectorThread()
+{
+	if (sectorThread == nullptr)
+	{
+		return;
+	}
+	wzMutexLock(sectorMutex);
+	sectorThreadQuit = true;
+	sectorJobs.clear();
+	wzMutexUnlock(sectorMutex);
+	wzSemaphorePost(sectorSemaphore); // Wake up thread.
+
+	wzThreadJoin(sectorThread);
+	sectorThread = nullptr;
+	sectorResults.clear();
+	wzMutexDestroy(sectorMutex);
+	sectorMutex = nullptr;
+	wzSemaphoreDestroy(sectorSemaphore);
+	sectorSemaphore = nullptr;
+}
 
-	free(decaldata);
+/// Queue a rebuild of the sector's geometry on the sector thread
+static void queueSectorRebuild(int x, int y)
+{
+	auto job = std::unique_ptr<SectorGeometry>(new SectorGeometry());
+	job->x = x;
+	job->y = y;
+	copySectorTiles(&job->tiles, x, y);
+
+	sectors[x * ySectors + y].pending = true;
+	wzMutexLock(sectorMutex);
+	sectorJobs.push_back(std::move(job));
+	wzMutexUnlock(sectorMutex);
+	wzSemaphorePost(sectorSemaphore);
+}
+
+/// Upload the sectors the sector thread has finished since the last frame
+static void uploadRebuiltSectors()
+{
+	static std::vector<std::unique_ptr<SectorGeometry>> finished;  // Static, to save allocations.
+
+	wzMutexLock(sectorMutex);
+	std::swap(finished, sectorResults);
+	wzMutexUnlock(sectorMutex);
+
+	for (const auto& data : finished)
+	{
+		uploadSectorGeometry(*data);
+		sectors[data->x * ySectors + data->y].pending = false;
+	}
+	finished.clear();
+}
+
+/// Build and upload the sector's geometry right away (used the first time a sector becomes visible)
+static void generateSector(int x, int y)
+{
+	static SectorGeometry data;  // Static, to save allocations.
+	data.x = x;
+	data.y = y;
+	copySectorTiles(&data.tiles, x, y);
+	buildSectorGeometry(data);
+	uploadSectorGeometry(data);
 }
 
 /**
  * Mark all tiles that are influenced by this grid point as dirty.
- * Dirty sectors will later get updated by updateSectorGeometry.
+ * Dirty sectors will later get rebuilt on the sector thread, once they are visible.
  */
 void markTileDirty(int i, int j)
 {
@@ -624,9 +828,6 @@ bool initTerrain()
 	PIELIGHT colour[2][2], centerColour;
 	int layer = 0;
 
-	RenderVertex* geometry;
-	RenderVertex* water;
-	DecalVertex* decaldata;
 	int geometrySize, geometryIndexSize;
 	int waterSize, waterIndexSize;
 	int textureSize, textureIndexSize;
@@ -697,14 +898,12 @@ bool initTerrain()
 	sectors = std::unique_ptr<Sector[]>(new Sector[xSectors * ySectors]());
 
 	////////////////////
-	// fill the geometry part of the sectors
-	geometry = (RenderVertex*)malloc(
-		sizeof(RenderVertex) * xSectors * ySectors * (sectorSize + 1) * (sectorSize + 1) * 2);
+	// lay out the geometry part of the sectors
+	// (the vertices themselves are generated once a sector first becomes visible, see cullTerrain)
 	geometryIndex = (GLuint*)malloc(sizeof(GLuint) * xSectors * ySectors * sectorSize * sectorSize * 12);
 	geometrySize = 0;
 	geometryIndexSize = 0;
 
-	water = (RenderVertex*)malloc(sizeof(RenderVertex) * xSectors * ySectors * (sectorSize + 1) * (sectorSize + 1) * 2);
 	waterIndex = (GLuint*)malloc(sizeof(GLuint) * xSectors * ySectors * sectorSize * sectorSize * 12);
 	waterSize = 0;
 	waterIndexSize = 0;
@@ -712,16 +911,15 @@ bool initTerrain()
 	{
 		for (y = 0; y < ySectors; y++)
 		{
-			sectors[x * ySectors + y].dirty = false;
+			sectors[x * ySectors + y].dirty = true;
+			sectors[x * ySectors + y].generated = false;
+			sectors[x * ySectors + y].pending = false;
 			sectors[x * ySectors + y].geometryOffset = geometrySize;
-			sectors[x * ySectors + y].geometrySize = 0;
+			sectors[x * ySectors + y].geometrySize = sectorVertexCount();
 			sectors[x * ySectors + y].waterOffset = waterSize;
-			sectors[x * ySectors + y].waterSize = 0;
-
-			setSectorGeometry(x, y, geometry, water, &geometrySize, &waterSize);
-
-			sectors[x * ySectors + y].geometrySize = geometrySize - sectors[x * ySectors + y].geometryOffset;
-			sectors[x * ySectors + y].waterSize = waterSize - sectors[x * ySectors + y].waterOffset;
+			sectors[x * ySectors + y].waterSize = sectorVertexCount();
+			geometrySize += sectorVertexCount();
+			waterSize += sectorVertexCount();
 			// and do the index buffers
 			sectors[x * ySectors + y].geometryIndexOffset = geometryIndexSize;
 			sectors[x * ySectors + y].geometryIndexSize = 0;
@@ -796,8 +994,7 @@ bool initTerrain()
 		delete geometryVBO;
 	geometryVBO = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer,
 	                                                           gfx_api::context::buffer_storage_hint::dynamic_draw);
-	geometryVBO->upload(sizeof(RenderVertex) * geometrySize, geometry);
-	free(geometry);
+	geometryVBO->upload(sizeof(RenderVertex) * geometrySize, nullptr);
 
 	if (geometryIndexVBO)
 		delete geometryIndexVBO;
@@ -809,8 +1006,7 @@ bool initTerrain()
 		delete waterVBO;
 	waterVBO = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer,
 	                                                        gfx_api::context::buffer_storage_hint::dynamic_draw);
-	waterVBO->upload(sizeof(RenderVertex) * waterSize, water);
-	free(water);
+	waterVBO->upload(sizeof(RenderVertex) * waterSize, nullptr);
 
 	if (waterIndexVBO)
 		delete waterIndexVBO;
@@ -950,16 +1146,14 @@ bool initTerrain()
 	free(textureIndex);
 
 	// and finally the decals
-	decaldata = (DecalVertex*)malloc(sizeof(DecalVertex) * mapWidth * mapHeight * 12);
 	decalSize = 0;
 	for (x = 0; x < xSectors; x++)
 	{
 		for (y = 0; y < ySectors; y++)
 		{
 			sectors[x * ySectors + y].decalOffset = decalSize;
-			sectors[x * ySectors + y].decalSize = 0;
-			setSectorDecals(x, y, decaldata, &decalSize);
-			sectors[x * ySectors + y].decalSize = decalSize - sectors[x * ySectors + y].decalOffset;
+			sectors[x * ySectors + y].decalSize = countSectorDecalVertices(x, y);
+			decalSize += sectors[x * ySectors + y].decalSize;
 		}
 	}
 	debug(LOG_TERRAIN, "%i decals found", decalSize / 12);
@@ -969,13 +1163,12 @@ bool initTerrain()
 	{
 		decalVBO = gfx_api::context::get().create_buffer_object(gfx_api::buffer::usage::vertex_buffer,
 		                                                        gfx_api::context::buffer_storage_hint::dynamic_draw);
-		decalVBO->upload(sizeof(DecalVertex) * decalSize, decaldata);
+		decalVBO->upload(sizeof(DecalVertex) * decalSize, nullptr);
 	}
 	else
 	{
 		decalVBO = nullptr;
 	}
-	free(decaldata);
 
 	lightmapLastUpdate = 0;
 	lightmapWidth = 1;
@@ -1005,6 +1198,7 @@ bool initTerrain()
 
 	lightmap_texture->upload(0, 0, 0, lightmapWidth, lightmapHeight, gfx_api::pixel_format::FORMAT_RGB8_UNORM_PACK8,
 	                         lightmapPixmap.get());
+	startSectorThread();
 	terrainInitialised = true;
 
 	return true;
@@ -1019,6 +1213,7 @@ void shutdownTerrain()
 		debug(LOG_ERROR, "Trying to shutdown terrain when we did not need to!");
 		return;
 	}
+	stopSectorThread();
 	delete geometryVBO;
 	geometryVBO = nullptr;
 	delete geometryIndexVBO;
@@ -1123,6 +1318,8 @@ static void updateLightMap()
 
 static void cullTerrain()
 {
+	uploadRebuiltSectors();
+
 	for (int x = 0; x < xSectors; x++)
 	{
 		for (int y = 0; y < ySectors; y++)
@@ -1138,9 +1335,16 @@ static void cullTerrain()
 			else
 			{
 				sectors[x * ySectors + y].draw = true;
-				if (sectors[x * ySectors + y].dirty)
+				if (!sectors[x * ySectors + y].generated)
+				{
+					// first time this sector is visible, it has nothing to draw yet
+					generateSector(x, y);
+					sectors[x * ySectors + y].dirty = false;
+				}
+				else if (sectors[x * ySectors + y].dirty && !sectors[x * ySectors + y].pending)
 				{
-					updateSectorGeometry(x, y);
+					// keep drawing the old geometry until the rebuilt one is uploaded
+					queueSectorRebuild(x, y);
 					sectors[x * ySectors + y].dirty = false;
 				}
 			}
@@ -41,6 +41,7 @@ enum class HostLaunch
 	Host,
 	Skirmish,
 	Autohost,
+	LoadReplay, ///< Play back a replay (headless: as fast as possible, verifying sync)
 };
 
 void setHostLaunch(HostLaunch value);
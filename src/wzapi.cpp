@@ -31,6 +31,7 @@
 #include "lib/sound/audio.h"
 #include "lib/sound/cdaudio.h"
 #include "lib/netplay/netplay.h"
+#include "lib/gamelib/gtime.h"
 #include "qtscript.h"
 #include "lib/ivis_opengl/tex.h"
 
@@ -83,7 +84,11 @@
 #include "fpath.h"
 #include "display.h"
 
+#include <algorithm>
+#include <limits>
 #include <list>
+#include <map>
+#include <tuple>
 #include <utility>
 
 /// Assert for scripts that give useful backtraces and other info.
@@ -227,6 +232,23 @@ void wzapi::scripting_instance::dumpScriptLog(const std::string& info, int me) c
 	}
 }
 
+bool wzapi::scripting_instance::writeProfiledStacks() const
+{
+	if (m_profiledStacks.empty())
+	{
+		return false;
+	}
+	// Sorted, so profiles of different runs can be diffed
+	std::map<std::string, uint64_t> sortedStacks(m_profiledStacks.begin(), m_profiledStacks.end());
+	std::string data;
+	for (const auto& stack : sortedStacks)
+	{
+		data += stack.first + " " + std::to_string(stack.second) + "\n";
+	}
+	std::string path = "logs/" + scriptName() + "." + std::to_string(player()) + ".folded";
+	return saveFile(path.c_str(), data.c_str(), static_cast<UDWORD>(data.size()));
+}
+
 wzapi::execution_context_base::~execution_context_base() = default;
 
 wzapi::execution_context::~execution_context() = default;
@@ -1008,11 +1030,96 @@ bool wzapi::structureIdle(WZAPI_PARAMS(const Structure *psStruct))
 	return ::structureIdle(psStruct);
 }
 
+// MARK: Enumeration cache
+//
+// AI scripts tend to call the enum functions over and over with the same parameters within a
+// single tick, and with several AIs on one host each of them re-walks the same lists. Results
+// are therefore kept until the object lists or alliances change or game time moves on. Host-only
+// AIs get a cache of their own, so that scripts that run on every client (rules, campaign) never
+// see a result that only exists on the host because some AI happened to ask for it first.
+// enumRange() is not cached, as objects move between the events fired within one tick, and
+// neither are calls with a playerFilter other than ALL_PLAYERS, as visibility changes within one
+// tick as well.
+
+namespace
+{
+	enum class EnumCacheFunction
+	{
+		Struct,
+		StructOffWorld,
+		Droid,
+		Feature
+	};
+
+	struct EnumCacheKey
+	{
+		EnumCacheFunction function;
+		bool hostAI = false;
+		unsigned player = 0; ///< Owner for enumStruct / enumDroid
+		unsigned playerFilter = 0;
+		int type = 0;
+		std::string statsName;
+
+		bool operator<(const EnumCacheKey& other) const
+		{
+			return std::tie(function, hostAI, player, playerFilter, type, statsName)
+				< std::tie(other.function, other.hostAI, other.player, other.playerFilter, other.type, other.statsName);
+		}
+	};
+
+	struct EnumCache
+	{
+		uint32_t time = 0;
+		unsigned listGeneration = 0;
+		std::vector<uint8_t> alliances; ///< Copy of alliancebits, which the ALLIES / ENEMIES filters depend on
+		std::map<EnumCacheKey, std::vector<const BaseObject*>> results;
+	};
+}
+
+static EnumCache enumCache; // WARNING: THREAD-SAFETY
+
+template <typename T, typename Enumerate>
+static std::vector<const T*> enumCached(const wzapi::execution_context& context, EnumCacheKey key, Enumerate enumerate)
+{
+	if (key.playerFilter != ALL_PLAYERS)
+	{
+		return enumerate(); // depends on isVisibleToPlayer(), which is not tracked by the cache
+	}
+	const uint8_t* currentAlliances = reinterpret_cast<const uint8_t*>(alliancebits);
+	if (enumCache.time != gameTime || enumCache.listGeneration != objmemListGeneration()
+		|| !std::equal(enumCache.alliances.begin(), enumCache.alliances.end(), currentAlliances, currentAlliances + sizeof(alliancebits)))
+	{
+		enumCache.results.clear();
+		enumCache.time = gameTime;
+		enumCache.listGeneration = objmemListGeneration();
+		enumCache.alliances.assign(currentAlliances, currentAlliances + sizeof(alliancebits));
+	}
+	const wzapi::scripting_instance* instance = context.currentInstance();
+	key.hostAI = instance != nullptr && instance->isHostAI();
+
+	std::vector<const T*> matches;
+	auto it = enumCache.results.find(key);
+	if (it != enumCache.results.end())
+	{
+		matches.reserve(it->second.size());
+		for (const BaseObject* psObj : it->second)
+		{
+			if (!psObj->damageManager->isDead())
+			{
+				matches.push_back(static_cast<const T*>(psObj));
+			}
+		}
+		return matches;
+	}
+	matches = enumerate();
+	enumCache.results.emplace(std::move(key), std::vector<const BaseObject*>(matches.begin(), matches.end()));
+	return matches;
+}
+
 std::vector<const Structure*> _enumStruct_fromList(
 				WZAPI_PARAMS(optional<int> _player, optional<wzapi::STRUCTURE_TYPE_or_statsName_string> _structureType,
-	             optional<int> _playerFilter), Structure** psStructLists)
+	             optional<int> _playerFilter), Structure** psStructLists, EnumCacheFunction cacheFunction)
 {
-	std::vector<const Structure*> matches;
 	WzString statsName;
 	STRUCTURE_TYPE type = STRUCTURE_TYPE::COUNT;
 
@@ -1027,18 +1134,26 @@ std::vector<const Structure*> _enumStruct_fromList(
 	SCRIPT_ASSERT_PLAYER({}, context, player);
 	SCRIPT_ASSERT({}, context, (playerFilter >= 0 && playerFilter < MAX_PLAYERS) ||
           playerFilter == ALL_PLAYERS, "Player filter index out of range: %d", playerFilter);
-  
-	for (auto psStruct : psStructLists[player])
-	{
-		if ((playerFilter == ALL_PLAYERS || psStruct->isVisibleToPlayer(playerFilter))
-			&& !psStruct->damageManager->isDead()
-			&& (type == STRUCTURE_TYPE::COUNT || type == psStruct->getStats()->type)
-			&& (statsName.isEmpty() || statsName.compare(psStruct->getStats()->id) == 0)) {
-			matches.push_back(psStruct);
-		}
-	}
 
-	return matches;
+	EnumCacheKey key;
+	key.function = cacheFunction;
+	key.player = player;
+	key.playerFilter = playerFilter;
+	key.type = (int)type;
+	key.statsName = statsName.toStdString();
+	return enumCached<Structure>(context, std::move(key), [&]() {
+		std::vector<const Structure*> matches;
+		for (auto psStruct : psStructLists[player])
+		{
+			if ((playerFilter == ALL_PLAYERS || psStruct->isVisibleToPlayer(playerFilter))
+				&& !psStruct->damageManager->isDead()
+				&& (type == STRUCTURE_TYPE::COUNT || type == psStruct->getStats()->type)
+				&& (statsName.isEmpty() || statsName.compare(psStruct->getStats()->id) == 0)) {
+				matches.push_back(psStruct);
+			}
+		}
+		return matches;
+	});
 }
 
 //-- ## enumStruct([player[, structureType[, playerFilter]]])
@@ -1054,7 +1169,7 @@ std::vector<const Structure*> wzapi::enumStruct(WZAPI_PARAMS(optional<int> _play
 																														 optional<STRUCTURE_TYPE_or_statsName_string>
                                                              _structureType, optional<int> _playerFilter))
 {
-	return _enumStruct_fromList(context, _player, _structureType, _playerFilter, apsStructLists);
+	return _enumStruct_fromList(context, _player, _structureType, _playerFilter, apsStructLists, EnumCacheFunction::Struct);
 }
 
 //-- ## enumStructOffWorld([player[, structureType[, playerFilter]]])
@@ -1070,7 +1185,7 @@ std::vector<const Structure*> wzapi::enumStructOffWorld(WZAPI_PARAMS(optional<in
 																																		 optional<STRUCTURE_TYPE_or_statsName_string>
                                                                      _structureType, optional<int> _playerFilter))
 {
-	return _enumStruct_fromList(context, _player, _structureType, _playerFilter, (mission.apsStructLists));
+	return _enumStruct_fromList(context, _player, _structureType, _playerFilter, (mission.apsStructLists), EnumCacheFunction::StructOffWorld);
 }
 
 //-- ## enumDroid([player[, droidType[, playerFilter]]])
@@ -1083,7 +1198,6 @@ std::vector<const Structure*> wzapi::enumStructOffWorld(WZAPI_PARAMS(optional<in
 std::vector<const Droid*> wzapi::enumDroid(WZAPI_PARAMS(optional<int> _player, optional<int> _droidType,
                                                         optional<int> _playerFilter))
 {
-	std::vector<const Droid*> matches;
 	DROID_TYPE droidType2;
 
 	unsigned player = _player.value_or(context.player());
@@ -1112,15 +1226,24 @@ std::vector<const Droid*> wzapi::enumDroid(WZAPI_PARAMS(optional<int> _player, o
 	SCRIPT_ASSERT_PLAYER({}, context, player);
 	SCRIPT_ASSERT({}, context, (playerFilter >= 0 && playerFilter < MAX_PLAYERS) || playerFilter == ALL_PLAYERS,
 	              "Player filter index out of range: %d", playerFilter);
-	for (auto& psDroid : playerList[player].droids)
-	{
-		if ((playerFilter == ALL_PLAYERS || psDroid.isVisibleToPlayer(playerFilter))
-		  	&& !psDroid.damageManager->isDead()
-		  	&& (droidType == DROID_TYPE::ANY || droidType == psDroid.getType() || droidType2 == psDroid.getType())) {
-			matches.push_back(&psDroid);
+
+	EnumCacheKey key;
+	key.function = EnumCacheFunction::Droid;
+	key.player = player;
+	key.playerFilter = playerFilter;
+	key.type = (int)droidType;
+	return enumCached<Droid>(context, std::move(key), [&]() {
+		std::vector<const Droid*> matches;
+		for (auto& psDroid : playerList[player].droids)
+		{
+			if ((playerFilter == ALL_PLAYERS || psDroid.isVisibleToPlayer(playerFilter))
+			  	&& !psDroid.damageManager->isDead()
+			  	&& (droidType == DROID_TYPE::ANY || droidType == psDroid.getType() || droidType2 == psDroid.getType())) {
+				matches.push_back(&psDroid);
+			}
 		}
-	}
-	return matches;
+		return matches;
+	});
 }
 
 //-- ## enumFeature(playerFilter[, featureName])
@@ -1138,16 +1261,22 @@ std::vector<const Feature*> wzapi::enumFeature(WZAPI_PARAMS(unsigned playerFilte
 		featureName = WzString::fromUtf8(_featureName.value());
 	}
 
-	std::vector<const Feature*> matches;
-	for (auto psFeat : apsFeatureLists[0])
-	{
-		if ((playerFilter == ALL_PLAYERS || psFeat->isVisibleToPlayer(playerFilter))
-			&& !psFeat->damageManager->isDead()
-			&& (featureName.isEmpty() || featureName.compare(psFeat->getStats()->id) == 0)) {
-			matches.push_back(psFeat);
+	EnumCacheKey key;
+	key.function = EnumCacheFunction::Feature;
+	key.playerFilter = playerFilter;
+	key.statsName = featureName.toStdString();
+	return enumCached<Feature>(context, std::move(key), [&]() {
+		std::vector<const Feature*> matches;
+		for (auto psFeat : apsFeatureLists[0])
+		{
+			if ((playerFilter == ALL_PLAYERS || psFeat->isVisibleToPlayer(playerFilter))
+				&& !psFeat->damageManager->isDead()
+				&& (featureName.isEmpty() || featureName.compare(psFeat->getStats()->id) == 0)) {
+				matches.push_back(psFeat);
+			}
 		}
-	}
-	return matches;
+		return matches;
+	});
 }
 
 //-- ## enumBlips(player)
@@ -1280,6 +1409,86 @@ std::vector<const BaseObject *> wzapi::enumRange(
 	return list;
 }
 
+/// Objects from enumRange() that are of the given type (any type if negative), nearest to (x, y) first.
+/// Ties go to the lower object id, so every client gets the same order.
+static std::vector<const BaseObject *> _enumRangeSorted(WZAPI_PARAMS(int _x, int _y, int _range, optional<int> _playerFilter,
+                                                        optional<bool> _seen, int objectType, size_t maxCount))
+{
+	std::vector<const BaseObject *> list = wzapi::enumRange(context, _x, _y, _range, _playerFilter, _seen);
+	if (objectType >= 0)
+	{
+		list.erase(std::remove_if(list.begin(), list.end(), [objectType](const BaseObject *psObj) {
+			return getObjectType(psObj) != (OBJECT_TYPE)objectType;
+		}), list.end());
+	}
+	const int x = world_coord(_x);
+	const int y = world_coord(_y);
+	auto distSq = [x, y](const BaseObject *psObj) {
+		int64_t dx = psObj->getPosition().x - x;
+		int64_t dy = psObj->getPosition().y - y;
+		return dx * dx + dy * dy;
+	};
+	auto nearer = [&distSq](const BaseObject *a, const BaseObject *b) {
+		int64_t distA = distSq(a);
+		int64_t distB = distSq(b);
+		return distA < distB || (distA == distB && a->getId() < b->getId());
+	};
+	if (maxCount < list.size())
+	{
+		std::partial_sort(list.begin(), list.begin() + maxCount, list.end(), nearer);
+		list.resize(maxCount);
+	}
+	else
+	{
+		std::sort(list.begin(), list.end(), nearer);
+	}
+	return list;
+}
+
+//-- ## enumRangeSorted(x, y, range[, playerFilter[, seen[, objectType[, count]]]])
+//--
+//-- Like ```enumRange()```, but the objects are sorted by distance from the given position, nearest first.
+//-- The optional objectType can be one of ```DROID```, ```STRUCTURE``` or ```FEATURE``` to only return objects
+//-- of that type, and the optional count limits the result to that many of the nearest objects. This is much
+//-- faster than sorting the result of ```enumRange()``` in script code. (4.3+ only)
+//--
+std::vector<const BaseObject *> wzapi::enumRangeSorted(WZAPI_PARAMS(int x, int y, int range, optional<int> _playerFilter,
+                                                                    optional<bool> _seen, optional<int> _objectType,
+                                                                    optional<int> _count))
+{
+	int objectType = _objectType.value_or(-1);
+	SCRIPT_ASSERT({}, context, objectType < 0 || objectType == (int)OBJECT_TYPE::DROID
+	              || objectType == (int)OBJECT_TYPE::STRUCTURE || objectType == (int)OBJECT_TYPE::FEATURE,
+	              "Invalid object type: %d", objectType);
+	int count = _count.value_or(std::numeric_limits<int>::max());
+	SCRIPT_ASSERT({}, context, count >= 0, "Invalid count: %d", count);
+	return _enumRangeSorted(context, x, y, range, _playerFilter, _seen, objectType, static_cast<size_t>(count));
+}
+
+//-- ## findNearest(x, y, range[, playerFilter[, seen[, objectType]]])
+//--
+//-- Returns the game object nearest to the given position within range that passes the optional
+//-- playerFilter, seen (as for ```enumRange()```) and objectType (one of ```DROID```, ```STRUCTURE``` or
+//-- ```FEATURE```) filters, or null if there is none. The optional parameters are in the same order as for
+//-- ```enumRangeSorted()```. (4.3+ only)
+//--
+wzapi::returned_nullable_ptr<const BaseObject> wzapi::findNearest(WZAPI_PARAMS(int x, int y, int range,
+                                                                               optional<int> _playerFilter,
+                                                                               optional<bool> _seen,
+                                                                               optional<int> _objectType))
+{
+	int objectType = _objectType.value_or(-1);
+	SCRIPT_ASSERT(nullptr, context, objectType < 0 || objectType == (int)OBJECT_TYPE::DROID
+	              || objectType == (int)OBJECT_TYPE::STRUCTURE || objectType == (int)OBJECT_TYPE::FEATURE,
+	              "Invalid object type: %d", objectType);
+	std::vector<const BaseObject *> list = _enumRangeSorted(context, x, y, range, _playerFilter, _seen, objectType, 1);
+	if (list.empty())
+	{
+		return nullptr;
+	}
+	return list.front();
+}
+
 //-- ## pursueResearch(labStructure, research)
 //--
 //-- Start researching the first available technology on the way to the given technology.
@@ -1324,11 +1533,9 @@ bool wzapi::pursueResearch(WZAPI_PARAMS(const Structure *psStruct, string_or_str
 	ResearchFacility* psResLab = (ResearchFacility*)psStruct->pFunctionality;
 	SCRIPT_ASSERT(false, context, psResLab->psSubject == nullptr, "Research lab not ready");
 	// Go down the requirements list for the desired tech
-	std::list<ResearchStats*> reslist;
-	ResearchStats* curResearch = psResearch;
-	int iterations = 0; // Only used to assert we're not stuck in the loop.
-	while (curResearch)
+	for (unsigned index : researchPathTowards(psResearch->index, player))
 	{
+		ResearchStats* curResearch = &asResearch[index];
 		if (researchAvailable(curResearch->index, player, ModeQueue))
 		{
 			bool started = false;
@@ -1354,25 +1561,6 @@ bool wzapi::pursueResearch(WZAPI_PARAMS(const Structure *psStruct, string_or_str
 				return true;
 			}
 		}
-		ResearchStats* prevResearch = curResearch;
-		curResearch = nullptr;
-		if (!prevResearch->pPRList.empty())
-		{
-			curResearch = &asResearch[prevResearch->pPRList[0]]; // get first pre-req
-		}
-		for (int i = 1; i < prevResearch->pPRList.size(); i++)
-		{
-			// push any other pre-reqs on the stack
-			reslist.push_back(&asResearch[prevResearch->pPRList[i]]);
-		}
-		if (!curResearch && !reslist.empty())
-		{
-			curResearch = reslist.front(); // retrieve options from the stack
-			reslist.pop_front();
-		}
-		ASSERT_OR_RETURN(false, ++iterations < asResearch.size() * 100 || !curResearch,
-		                 "Possible cyclic dependencies in prerequisites, possibly of research \"%s\".",
-		                 getStatsName(curResearch));
 	}
 	debug(LOG_SCRIPT, "No research topic found for %s(%d)", objInfo(psStruct), psStruct->getId());
 	return false; // none found
@@ -65,6 +65,7 @@ using nonstd::nullopt;
 #include <vector>
 #include <memory>
 #include <functional>
+#include <unordered_map>
 
 typedef uint64_t uniqueTimerID;
 
@@ -665,6 +666,17 @@ namespace wzapi
 		void dumpScriptLog(const std::string& info);
 		void dumpScriptLog(const std::string& info, int me) const;
 
+	public:
+		// Call stack profiling
+		//
+		// While enabled, the time spent running script code is added up per call stack, keyed by the stack in the
+		// collapsed form read by flame graph tools ("outermost;...;innermost"). Backends that cannot inspect their
+		// call stacks record nothing.
+		virtual void setStackProfiling(bool enabled) { }
+		inline void recordProfiledStack(const std::string& stack, uint64_t microseconds) { m_profiledStacks[stack] += microseconds; }
+		// write the recorded stacks to "logs/<scriptName>.<player>.folded", one "stack microseconds" line each
+		bool writeProfiledStacks() const;
+
 	public:
 		virtual void updateGameTime(unsigned gameTime) = 0;
 		virtual void updateGroupSizes(int group, int size) = 0;
@@ -695,6 +707,7 @@ namespace wzapi
 		std::string m_scriptName;
 		std::string m_scriptPath;
 		bool m_isReceivingAllEvents = false;
+		std::unordered_map<std::string, uint64_t> m_profiledStacks;
 	};
 
 	class execution_context_base
@@ -1097,6 +1110,11 @@ namespace wzapi
 	researchResults enumResearch(WZAPI_NO_PARAMS);
 	std::vector<const BaseObject *> enumRange(WZAPI_PARAMS(int x, int y, int range, optional<unsigned> _playerFilter,
                                                               optional<bool> _seen));
+	std::vector<const BaseObject *> enumRangeSorted(WZAPI_PARAMS(int x, int y, int range, optional<int> _playerFilter,
+                                                                    optional<bool> _seen, optional<int> _objectType,
+                                                                    optional<int> _count));
+	returned_nullable_ptr<const BaseObject> findNearest(WZAPI_PARAMS(int x, int y, int range, optional<int> _playerFilter,
+                                                                    optional<bool> _seen, optional<int> _objectType));
 	bool pursueResearch(WZAPI_PARAMS(const Structure *psStruct, string_or_string_list research));
 	researchResults findResearch(WZAPI_PARAMS(std::string researchName, optional<unsigned> _player));
 	int distBetweenTwoPoints(WZAPI_PARAMS(int x1, int y1, int x2, int y2));
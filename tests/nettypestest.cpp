@@ -0,0 +1,109 @@
+#include "lib/framework/wzglobal.h"
+#include "lib/framework/types.h"
+#include "lib/framework/frame.h"
+#include "lib/netplay/netplay.h"
+#include "lib/netplay/nettypes.h"
+
+#include <vector>
+
+// --- dummy rendering library implementation ----
+
+void wzToggleFullscreen()
+{
+}
+
+bool wzIsFullscreen()
+{
+	return false;
+}
+
+void wzFatalDialog(char const*)
+{
+}
+
+int wzGetTicks()
+{
+	return 1;
+}
+
+void inputInitialise()
+{
+}
+
+// --- end linking hacks ---
+
+static int failures = 0;
+
+/// Encodes the raw values, as a hostile client could, then decodes them with NETuint32_tSet().
+static std::vector<uint32_t> decodeRaw(std::vector<uint32_t> values)
+{
+	NETinitQueue(NETgameQueue(0));
+	NETsetNoSendOverNetwork(NETgameQueue(0));
+
+	NETbeginEncode(NETgameQueue(0), GAME_DROIDINFO);
+	for (uint32_t &value : values)
+	{
+		NETuint32_t(&value);
+	}
+	NETend();
+
+	std::vector<uint32_t> ids;
+	NETbeginDecode(NETgameQueue(0), GAME_DROIDINFO);
+	NETuint32_tSet(&ids);
+	NETend();
+	NETpop(NETgameQueue(0));
+	return ids;
+}
+
+static std::vector<uint32_t> roundTrip(std::vector<uint32_t> ids)
+{
+	NETinitQueue(NETgameQueue(0));
+	NETsetNoSendOverNetwork(NETgameQueue(0));
+
+	NETbeginEncode(NETgameQueue(0), GAME_DROIDINFO);
+	NETuint32_tSet(&ids);
+	NETend();
+
+	std::vector<uint32_t> decoded;
+	NETbeginDecode(NETgameQueue(0), GAME_DROIDINFO);
+	NETuint32_tSet(&decoded);
+	NETend();
+	NETpop(NETgameQueue(0));
+	return decoded;
+}
+
+static void check(bool ok, char const *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "nettypestest: %s\n", what);
+		++failures;
+	}
+}
+
+int main(void)
+{
+	frameInitialise();
+
+	check(roundTrip({}).empty(), "Empty set did not round-trip");
+	check(roundTrip({0}) == std::vector<uint32_t>({0}), "Id 0 did not round-trip");
+	check(roundTrip({7, 3, 5, 4, 3, 10, 11, UINT32_MAX}) == std::vector<uint32_t>({3, 4, 5, 7, 10, 11, UINT32_MAX}), "Unsorted ids with duplicates did not round-trip");
+
+	std::vector<uint32_t> block;
+	for (uint32_t id = 1000; id < 1300; ++id)
+	{
+		block.push_back(id);
+	}
+	check(roundTrip(block) == block, "Run of 300 ids did not round-trip");
+
+	// Hostile input: number of runs, then (gap, length - 1) for each run.
+	check(decodeRaw({2, 5, 0, 2, 0}) == std::vector<uint32_t>({5, 7}), "Gap of 2 after the first run was rejected");
+	check(decodeRaw({2, 5, 0, 1, 0}).empty(), "Gap of 1 continuing the previous run was accepted");
+	check(decodeRaw({2, 5, 0, 0, 0}).empty(), "Gap of 0 repeating the previous id was accepted");
+	check(decodeRaw({1, 0, 20000}).empty(), "Run longer than maxCount was accepted");
+	check(decodeRaw({2, UINT32_MAX, 0, 2, 0}).empty(), "Run past UINT32_MAX was accepted");
+
+	NETdeleteQueue();
+	frameShutDown();
+	return failures > 0 ? 1 : 0;
+}